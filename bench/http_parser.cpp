@@ -0,0 +1,127 @@
+// Request parser microbenchmark, bytes per TSC cycle for every scan kernel
+// the CPU has: once for the bare scans over the request heads, once for
+// full req_msg parses.
+// usage: http_parser_bench [rounds]
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <print>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <x86intrin.h>
+#include "http.h"
+#include "simd.h"
+using namespace seele;
+
+namespace {
+
+// What browsers and load generators send, short and long
+std::vector<std::string> make_corpus() {
+    return {
+        "GET / HTTP/1.1\r\n"
+        "Host: localhost\r\n"
+        "\r\n",
+
+        "GET /static/js/app.bundle.min.js?v=20240101 HTTP/1.1\r\n"
+        "Host: www.example.com\r\n"
+        "Connection: keep-alive\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/126.0.0.0 Safari/537.36\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp\r\n"
+        "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+        "Accept-Language: en-US,en;q=0.9\r\n"
+        "Cache-Control: max-age=0\r\n"
+        "Sec-Fetch-Dest: document\r\n"
+        "Sec-Fetch-Mode: navigate\r\n"
+        "Sec-Fetch-Site: none\r\n"
+        "Upgrade-Insecure-Requests: 1\r\n"
+        "\r\n",
+
+        "POST /api/v1/items/%E4%BD%A0%E5%A5%BD HTTP/1.1\r\n"
+        "Host: api.example.com\r\n"
+        "Content-Type: application/json\r\n"
+        "Content-Length: 26\r\n"
+        "X-Request-Id: 5f0c9b2e-8a7d-4c1b-9e3f-2a6d8b7c4e10\r\n"
+        "\r\n"
+        "{\"name\":\"item\",\"count\":42}",
+    };
+}
+
+template<typename function_t>
+double bytes_per_cycle(size_t bytes, function_t&& fn) {
+    uint64_t start = __rdtsc();
+    fn();
+    uint64_t cycles = __rdtsc() - start;
+    return static_cast<double>(bytes) / static_cast<double>(cycles);
+}
+
+constexpr std::string_view isa_name(simd::isa isa) {
+    switch (isa) {
+        case simd::isa::scalar: return "scalar";
+        case simd::isa::sse42: return "sse4.2";
+        case simd::isa::avx2: return "avx2";
+    }
+    return "?";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    size_t rounds = 200'000;
+    if (argc > 1) {
+        std::string_view arg{argv[1]};
+        std::from_chars(arg.data(), arg.data() + arg.size(), rounds);
+    }
+
+    auto corpus = make_corpus();
+    size_t corpus_bytes = 0;
+    for (const auto& req : corpus) {
+        corpus_bytes += req.size();
+    }
+    const size_t total = corpus_bytes * rounds;
+
+    std::println("{:<8}{:>16}{:>16}", "isa", "scan B/cycle", "parse B/cycle");
+    for (auto target : {simd::isa::scalar, simd::isa::sse42, simd::isa::avx2}) {
+        if (simd::force_isa(target) != target) {
+            continue;
+        }
+
+        // what the parser scans: every line for its CRLF, every header name
+        size_t sink = 0;
+        double scan = bytes_per_cycle(total, [&] {
+            for (size_t r = 0; r < rounds; ++r) {
+                for (const auto& req : corpus) {
+                    std::string_view data = req;
+                    for (auto end = simd::find_crlf(data); end != std::string_view::npos; end = simd::find_crlf(data)) {
+                        sink += simd::span(data.substr(0, end), http::tchars);
+                        data.remove_prefix(end + 2);
+                    }
+                }
+            }
+        });
+
+        size_t parsed = 0;
+        double parse = bytes_per_cycle(total, [&] {
+            http::req_msg msg;
+            http::req_parser parser{msg};
+            for (size_t r = 0; r < rounds; ++r) {
+                for (const auto& req : corpus) {
+                    parser.reset();
+                    parser.send(req);
+                    parsed += parser.done() && parser.get().has_value();
+                }
+            }
+        });
+
+        if (parsed != corpus.size() * rounds) {
+            std::println("{}: only {} of {} requests parsed", isa_name(target), parsed, corpus.size() * rounds);
+            return 1;
+        }
+        std::println("{:<8}{:>16.3f}{:>16.3f}", isa_name(target), scan, parse);
+        // keeps the scans from being optimized out
+        if (sink == 0) {
+            std::println("no scans");
+        }
+    }
+}
@@ -0,0 +1,44 @@
+#!/bin/sh
+# Runs the unsharded server once per resume mode under the same wrk load
+# and prints requests/s and latency percentiles of each.
+#
+# usage: bench/resume_modes.sh <web_server> <root path> [address] [target]
+#   e.g. bench/resume_modes.sh build/web_server static 127.0.0.1:8080 /index.html
+# THREADS, CONNS and DURATION override the wrk load (10, 1500, 15s as in test.sh),
+# EXTRA is passed to every server run, e.g. EXTRA="--pin-cpu --workers 4".
+set -eu
+
+server=$1
+root=$2
+addr=${3:-127.0.0.1:8080}
+target=${4:-/index.html}
+threads=${THREADS:-10}
+conns=${CONNS:-1500}
+duration=${DURATION:-15s}
+extra=${EXTRA:-}
+
+run_mode() {
+    name=$1
+    shift
+    # shellcheck disable=SC2086
+    "$server" --address "$addr" --path "$root" $extra "$@" >/dev/null 2>&1 &
+    pid=$!
+    for _ in $(seq 50); do
+        curl -s -o /dev/null "http://$addr$target" && break
+        sleep 0.1
+    done
+    out=$(wrk -t"$threads" -c"$conns" -d"$duration" -T2s --latency "http://$addr$target")
+    kill -INT "$pid"
+    wait "$pid" || true
+
+    rps=$(echo "$out" | awk '/Requests\/sec/ { print $2 }')
+    p50=$(echo "$out" | awk '$1 == "50%" { print $2 }')
+    p99=$(echo "$out" | awk '$1 == "99%" { print $2 }')
+    errors=$(echo "$out" | awk '/Non-2xx|Socket errors/ { $1 = $1; print }' | tr '\n' ' ')
+    printf '%-18s %12s %10s %10s  %s\n' "$name" "$rps" "$p50" "$p99" "$errors"
+}
+
+printf '%-18s %12s %10s %10s\n' "mode" "req/s" "p50" "p99"
+run_mode dispatch
+run_mode selective --selective-resume
+run_mode run-to-completion --run-to-completion
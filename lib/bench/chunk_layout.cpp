@@ -0,0 +1,90 @@
+// Contention benchmark of the chunk layouts of mpsc_queue and msc_queue.
+// usage: seele_chunk_bench [max_threads] [items_per_producer]
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <print>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "structs/mpsc_queue.h"
+#include "structs/msc_queue.h"
+using namespace seele::structs;
+
+namespace {
+
+size_t parse_or(const char* arg, size_t fallback) {
+    size_t value = fallback;
+    std::string_view sv{arg};
+    std::from_chars(sv.data(), sv.data() + sv.size(), value);
+    return value;
+}
+
+constexpr std::string_view layout_name(chunk_layout layout) {
+    switch (layout) {
+        case chunk_layout::packed: return "packed";
+        case chunk_layout::split: return "split";
+        case chunk_layout::padded: return "padded";
+    }
+    return "?";
+}
+
+// Runs `producers` threads pushing `items` each against `consumers` threads
+// popping until everything arrived, returns the items moved per second
+template<typename queue_t>
+double run(size_t producers, size_t consumers, size_t items) {
+    queue_t queue;
+    std::atomic<bool> go{false};
+    std::atomic<size_t> popped{0};
+    const size_t total = producers * items;
+
+    std::vector<std::jthread> threads;
+    for (size_t p = 0; p < producers; ++p) {
+        threads.emplace_back([&] {
+            while (!go.load(std::memory_order_acquire)) {}
+            for (size_t i = 0; i < items; ++i) {
+                queue.push_back(i);
+            }
+        });
+    }
+    for (size_t c = 0; c < consumers; ++c) {
+        threads.emplace_back([&] {
+            while (!go.load(std::memory_order_acquire)) {}
+            while (popped.load(std::memory_order_relaxed) < total) {
+                if (queue.pop_front()) {
+                    popped.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    threads.clear();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return total / elapsed.count();
+}
+
+template<chunk_layout LAYOUT>
+void bench_layout(size_t max_threads, size_t items) {
+    for (size_t producers = 1; producers <= max_threads; producers *= 2) {
+        double mpsc = run<mpsc_queue<uint64_t, 64, 16, mpsc_hazard_manager, LAYOUT>>(producers, 1, items);
+        double msc = run<msc_queue<uint64_t, 64, 16, hazard_manager, LAYOUT>>(producers, producers, items);
+        std::println("{:<8}{:>10}{:>18.0f}{:>18.0f}", layout_name(LAYOUT), producers, mpsc, msc);
+    }
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    size_t max_threads = argc > 1 ? parse_or(argv[1], 8) : std::max(1u, std::thread::hardware_concurrency() / 2);
+    size_t items = argc > 2 ? parse_or(argv[2], 1'000'000) : 1'000'000;
+
+    std::println("{:<8}{:>10}{:>18}{:>18}", "layout", "producers", "mpsc ops/s", "msc ops/s (PxP)");
+    bench_layout<chunk_layout::packed>(max_threads, items);
+    bench_layout<chunk_layout::split>(max_threads, items);
+    bench_layout<chunk_layout::padded>(max_threads, items);
+}
@@ -0,0 +1,325 @@
+// Throughput, latency, memory and reclamation benchmark of the queues.
+// usage: seele_bench [--threads N] [--items N] [--json]
+//   --threads  most producers (and consumers) to run, doubling from 1
+//   --items    items pushed by every producer
+//   --json     print the results as JSON instead of a table
+// Progress goes to stderr, results to stdout.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <malloc.h>
+#include <memory>
+#include <optional>
+#include <print>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "structs/ebr.h"
+#include "structs/hp.h"
+#include "structs/mpmc_ring.h"
+#include "structs/mpsc_hp.h"
+#include "structs/mpsc_queue.h"
+#include "structs/ms_queue.h"
+#include "structs/msc_queue.h"
+#include "structs/spsc_object_pool.h"
+#include "structs/spsc_queue.h"
+using namespace seele::structs;
+
+namespace {
+
+// every latency_stride-th item a consumer pops is timed
+constexpr size_t latency_stride = 16;
+// capacity of the bounded structures
+constexpr size_t bounded_capacity = 4096;
+
+uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// heap bytes in use, small blocks and mmapped ones
+size_t heap_in_use() {
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+// The queues under test, all moving producer timestamps behind one
+// push/pop interface. `max_producers`/`max_consumers` of 0 mean any number.
+template<typename queue_t, size_t MAX_PRODUCERS = 0, size_t MAX_CONSUMERS = 0>
+struct unbounded {
+    static constexpr size_t max_producers = MAX_PRODUCERS;
+    static constexpr size_t max_consumers = MAX_CONSUMERS;
+    queue_t queue;
+
+    void push(uint64_t value) { this->queue.push_back(value); }
+    std::optional<uint64_t> pop() { return this->queue.pop_front(); }
+};
+
+struct ring {
+    static constexpr size_t max_producers = 0;
+    static constexpr size_t max_consumers = 0;
+    mpmc_ring<uint64_t> queue{bounded_capacity};
+
+    void push(uint64_t value) {
+        while (!this->queue.try_push(value)) {
+            std::this_thread::yield();
+        }
+    }
+    std::optional<uint64_t> pop() { return this->queue.try_pop(); }
+};
+
+// spsc_queue of pointers into a spsc_object_pool, the way connections
+// hand buffers between the io and worker threads
+struct pooled {
+    static constexpr size_t max_producers = 1;
+    static constexpr size_t max_consumers = 1;
+    spsc_object_pool<uint64_t> pool{bounded_capacity};
+    spsc_queue<uint64_t*> queue;
+
+    void push(uint64_t value) {
+        uint64_t* obj;
+        while (!(obj = this->pool.allocate(value))) {
+            std::this_thread::yield();
+        }
+        this->queue.push_back(obj);
+    }
+    std::optional<uint64_t> pop() {
+        auto obj = this->queue.pop_front();
+        if (!obj) {
+            return std::nullopt;
+        }
+        uint64_t value = **obj;
+        this->pool.deallocate(*obj);
+        return value;
+    }
+};
+
+struct result_t {
+    std::string_view name;
+    size_t producers;
+    size_t consumers;
+    size_t items;
+    double ops_per_sec;
+    // p50, p90, p99, p99.9, max in nanoseconds
+    uint64_t latency[5];
+    // heap growth over the empty process, at the peak and after the run
+    size_t peak_bytes;
+    size_t final_bytes;
+    // retired and not yet reclaimed, when the queue has a reclaimer
+    std::optional<size_t> peak_pending;
+    std::optional<size_t> final_pending;
+    std::optional<chunk_cache_stats> chunks;
+};
+
+uint64_t percentile(const std::vector<uint64_t>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t idx = std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()));
+    return sorted[idx];
+}
+
+template<typename bench_t>
+result_t run(std::string_view name, size_t producers, size_t consumers, size_t items) {
+    const size_t total = producers * items;
+    std::vector<std::vector<uint64_t>> samples(consumers);
+    for (auto& s : samples) {
+        s.reserve(total / latency_stride + 1);
+    }
+
+    size_t baseline = heap_in_use();
+    auto bench = std::make_unique<bench_t>();
+    auto pending = [&]() -> std::optional<size_t> {
+        if constexpr (requires { bench->queue.reclaimer().retired_count(); }) {
+            return bench->queue.reclaimer().retired_count();
+        } else {
+            return std::nullopt;
+        }
+    };
+
+    result_t result{name, producers, consumers, items};
+    std::atomic<bool> go{false};
+    std::atomic<size_t> popped{0};
+
+    std::jthread monitor([&](std::stop_token st) {
+        while (!st.stop_requested()) {
+            size_t used = heap_in_use();
+            result.peak_bytes = std::max(result.peak_bytes, used > baseline ? used - baseline : 0);
+            if (auto n = pending()) {
+                result.peak_pending = std::max(result.peak_pending.value_or(0), *n);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    std::vector<std::jthread> threads;
+    for (size_t p = 0; p < producers; ++p) {
+        threads.emplace_back([&] {
+            while (!go.load(std::memory_order_acquire)) {}
+            for (size_t i = 0; i < items; ++i) {
+                bench->push(now_ns());
+            }
+        });
+    }
+    for (size_t c = 0; c < consumers; ++c) {
+        threads.emplace_back([&, c] {
+            auto& local = samples[c];
+            size_t count = 0;
+            while (!go.load(std::memory_order_acquire)) {}
+            while (popped.load(std::memory_order_relaxed) < total) {
+                auto item = bench->pop();
+                if (!item) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                if (count++ % latency_stride == 0) {
+                    local.push_back(now_ns() - *item);
+                }
+                popped.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    threads.clear();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    monitor.request_stop();
+    monitor.join();
+
+    size_t used = heap_in_use();
+    result.final_bytes = used > baseline ? used - baseline : 0;
+    result.peak_bytes = std::max(result.peak_bytes, result.final_bytes);
+    result.final_pending = pending();
+    if (result.final_pending) {
+        result.peak_pending = std::max(result.peak_pending.value_or(0), *result.final_pending);
+    }
+    if constexpr (requires { bench->queue.stats(); }) {
+        result.chunks = bench->queue.stats();
+    }
+    result.ops_per_sec = total / elapsed.count();
+
+    std::vector<uint64_t> all;
+    for (auto& s : samples) {
+        all.insert(all.end(), s.begin(), s.end());
+    }
+    std::ranges::sort(all);
+    result.latency[0] = percentile(all, 0.50);
+    result.latency[1] = percentile(all, 0.90);
+    result.latency[2] = percentile(all, 0.99);
+    result.latency[3] = percentile(all, 0.999);
+    result.latency[4] = all.empty() ? 0 : all.back();
+    return result;
+}
+
+// Runs bench_t at 1, 2, 4, ... threads on each side it allows more than one
+template<typename bench_t>
+void sweep(std::vector<result_t>& results, std::string_view name, size_t max_threads, size_t items) {
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        size_t producers = bench_t::max_producers ? std::min(threads, bench_t::max_producers) : threads;
+        size_t consumers = bench_t::max_consumers ? std::min(threads, bench_t::max_consumers) : threads;
+        if (threads > 1 && producers == 1 && consumers == 1) {
+            break;
+        }
+        std::println(stderr, "{} {}x{}", name, producers, consumers);
+        results.push_back(run<bench_t>(name, producers, consumers, items));
+    }
+}
+
+void print_optional(std::optional<size_t> value) {
+    if (value) {
+        std::print("{}", *value);
+    } else {
+        std::print("null");
+    }
+}
+
+void print_json(const std::vector<result_t>& results) {
+    std::println("{{");
+    std::println("  \"hardware_threads\": {},", std::thread::hardware_concurrency());
+    std::println("  \"latency_stride\": {},", latency_stride);
+    std::println("  \"results\": [");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto& r = results[i];
+        std::print("    {{\"queue\": \"{}\", \"producers\": {}, \"consumers\": {}, \"items_per_producer\": {}, "
+                   "\"ops_per_sec\": {:.0f}, ",
+                   r.name, r.producers, r.consumers, r.items, r.ops_per_sec);
+        std::print("\"latency_ns\": {{\"p50\": {}, \"p90\": {}, \"p99\": {}, \"p999\": {}, \"max\": {}}}, ",
+                   r.latency[0], r.latency[1], r.latency[2], r.latency[3], r.latency[4]);
+        std::print("\"memory\": {{\"peak_bytes\": {}, \"final_bytes\": {}}}, ", r.peak_bytes, r.final_bytes);
+        std::print("\"reclamation\": {{\"peak_pending\": ");
+        print_optional(r.peak_pending);
+        std::print(", \"final_pending\": ");
+        print_optional(r.final_pending);
+        std::print("}}, \"chunks\": ");
+        if (r.chunks) {
+            std::print("{{\"allocated\": {}, \"reused\": {}, \"freed\": {}}}",
+                       r.chunks->allocated, r.chunks->reused, r.chunks->freed);
+        } else {
+            std::print("null");
+        }
+        std::println("}}{}", i + 1 < results.size() ? "," : "");
+    }
+    std::println("  ]");
+    std::println("}}");
+}
+
+void print_table(const std::vector<result_t>& results) {
+    std::println("{:<16}{:>4}{:>4}{:>14}{:>10}{:>10}{:>10}{:>12}{:>12}{:>10}",
+                 "queue", "P", "C", "ops/s", "p50 ns", "p99 ns", "p999 ns", "max ns", "peak KiB", "pending");
+    for (const auto& r : results) {
+        std::println("{:<16}{:>4}{:>4}{:>14.0f}{:>10}{:>10}{:>10}{:>12}{:>12}{:>10}",
+                     r.name, r.producers, r.consumers, r.ops_per_sec,
+                     r.latency[0], r.latency[2], r.latency[3], r.latency[4],
+                     r.peak_bytes / 1024, r.peak_pending ? std::to_string(*r.peak_pending) : "-");
+    }
+}
+
+size_t parse_or(std::string_view sv, size_t fallback) {
+    size_t value = fallback;
+    std::from_chars(sv.data(), sv.data() + sv.size(), value);
+    return value;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    size_t max_threads = std::max(1u, std::thread::hardware_concurrency() / 2);
+    size_t items = 1'000'000;
+    bool json = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg{argv[i]};
+        if (arg == "--threads" && i + 1 < argc) {
+            max_threads = parse_or(argv[++i], max_threads);
+        } else if (arg == "--items" && i + 1 < argc) {
+            items = parse_or(argv[++i], items);
+        } else if (arg == "--json") {
+            json = true;
+        } else {
+            std::println(stderr, "usage: {} [--threads N] [--items N] [--json]", argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<result_t> results;
+    sweep<unbounded<ms_queue<uint64_t, hazard_manager>>>(results, "ms_queue/hp", max_threads, items);
+    sweep<unbounded<ms_queue<uint64_t, epoch_manager>>>(results, "ms_queue/ebr", max_threads, items);
+    sweep<unbounded<msc_queue<uint64_t, 64, 16, hazard_manager>>>(results, "msc_queue/hp", max_threads, items);
+    sweep<unbounded<msc_queue<uint64_t, 64, 16, epoch_manager>>>(results, "msc_queue/ebr", max_threads, items);
+    sweep<unbounded<mpsc_queue<uint64_t, 64, 16, mpsc_hazard_manager>, 0, 1>>(results, "mpsc_queue/hp", max_threads, items);
+    sweep<unbounded<mpsc_queue<uint64_t, 64, 16, epoch_manager>, 0, 1>>(results, "mpsc_queue/ebr", max_threads, items);
+    sweep<ring>(results, "mpmc_ring", max_threads, items);
+    sweep<unbounded<spsc_queue<uint64_t>, 1, 1>>(results, "spsc_queue", max_threads, items);
+    sweep<pooled>(results, "spsc_pool", max_threads, items);
+
+    if (json) {
+        print_json(results);
+    } else {
+        print_table(results);
+    }
+}
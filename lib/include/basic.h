@@ -1,4 +1,5 @@
 #pragma once
+#include <functional>
 #include <string_view>
 #include <vector>
 #include <array>
@@ -35,6 +36,29 @@ inline constexpr uint8_t hex_to_int(char c){
 }
 
 
+inline constexpr char to_lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+// ASCII case-insensitive comparison, as for header names
+inline constexpr bool iequals(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (to_lower(a[i]) != to_lower(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Transparent hash, lets unordered containers of std::string be searched by string_view
+struct string_hash {
+    using is_transparent = void;
+    size_t operator()(std::string_view str) const { return std::hash<std::string_view>{}(str); }
+};
+
 std::vector<std::string_view> split_string_view(std::string_view str, std::string_view delimiter);
 std::vector<std::string_view> split_string_view(std::string_view str, char delimiter);
 }
\ No newline at end of file
@@ -2,43 +2,94 @@
 #include <atomic>
 #include <climits>
 #include <cstddef>
-#include <semaphore>
+#include <cstdint>
+#include <memory>
+#include <span>
 #include <thread>
 #include <coroutine>
 #include <vector>
 #include "structs/msc_queue.h"
+#include "structs/parker.h"
+#include "structs/ws_deque.h"
 namespace seele::coro::thread {
+
+struct pool_options{
+    // 0 means one worker per CPU the process may run on
+    size_t workers = 0;
+    // worker i is pinned to cpus[i % cpus.size()], empty leaves them unpinned
+    std::vector<size_t> cpus;
+};
     
 
+// Work stealing pool. Every worker owns a Chase-Lev deque plus a LIFO slot
+// for the coroutine it dispatched last, which runs next while it's still hot
+// in cache. Dispatches from other threads go through a shared injection
+// queue, idle workers steal from random victims before parking.
 class pool{
 public:
     static pool& get_instance();
 
-    auto submit(std::coroutine_handle<> h){
-        tasks.emplace_back(h);
-        sem.release();
-    }
+    // Options of the instance, only takes effect before its first use
+    static void configure(const pool_options& opts);
+
+    void submit(std::coroutine_handle<> h);
+
+    // Queues all of them with a single wakeup, the woken worker takes a
+    // batch and wakes the next one to steal from it
+    void submit_bulk(std::span<const std::coroutine_handle<>> handles);
 
     pool(const pool&) = delete;        
     pool(pool&&) = delete;
     pool& operator=(const pool&) = delete;
     pool& operator=(pool&&) = delete;
 private:        
+    struct alignas(64) worker_state {
+        structs::ws_deque<std::coroutine_handle<>> deque;
+        // owner only, not stealable
+        std::coroutine_handle<> lifo = nullptr;
+        pool* owner = nullptr;
+    };
+
+    void worker(std::stop_token st, size_t index);
+
+    std::coroutine_handle<> find_task(worker_state& self, size_t index, uint64_t& rng);
+
+    std::coroutine_handle<> steal(size_t index, uint64_t& rng);
 
-    void worker(std::stop_token st);
+    // wakes a parked worker, if there is one
+    void notify();
 
-    pool(size_t worker_count);        
+    pool(const pool_options& opts);        
     ~pool();  
 
-    structs::msc_queue<std::coroutine_handle<>> tasks;        
+    inline static thread_local worker_state* local_worker = nullptr;
+    inline static pool_options options{};
+
+    std::vector<std::unique_ptr<worker_state>> states;
+    structs::msc_queue<std::coroutine_handle<>> injector;
+    structs::parker sleepers;
     std::vector<std::jthread> workers;
-    std::counting_semaphore<> sem;
 };
 
+bool set_affinity(std::thread::native_handle_type handle, size_t cpu);
+
+// lets the thread run on any of `cpus`
+bool set_affinity(std::thread::native_handle_type handle, std::span<const size_t> cpus);
+
+// CPUs the process may run on, as restricted by taskset or cgroups
+std::vector<size_t> available_cpus();
+
+// CPUs of NUMA node `node` the process may run on, empty if there are none
+std::vector<size_t> node_cpus(size_t node);
+
 inline auto dispatch(std::coroutine_handle<> handle) {
     pool::get_instance().submit(handle);
 }    
 
+inline auto dispatch_bulk(std::span<const std::coroutine_handle<>> handles) {
+    pool::get_instance().submit_bulk(handles);
+}
+
 struct dispatch_awaiter{
     bool await_ready() { return false; }
 
@@ -1,5 +1,8 @@
 #pragma once
+#include <array>
+#include <bit>
 #include <concepts>
+#include <cstdint>
 #include <functional>
 #include <optional>
 #include <type_traits>
@@ -201,15 +204,134 @@ consteval auto enum_name_table() {
 
 }
 
+// not constexpr, so a perfect_hash that can't be built fails to compile
+void no_perfect_hash_for_keys();
+
+// Perfect hash over a fixed set of non-empty keys, built at compile time.
+// A key is sampled at its length and its first, second, middle and last
+// byte; the sample picks a bucket, and every bucket has a displacement,
+// searched for here, that sends its keys to slots no other key uses. A
+// lookup is the sample, two table loads and one compare with the only key
+// that can be in the slot. With fold_case, letters match in either case.
+template <size_t N, bool fold_case = false>
+class perfect_hash {
+public:
+    consteval perfect_hash(const std::array<std::string_view, N>& keys) : keys(keys) {
+        this->slots.fill(empty);
+        std::array<size_t, buckets> sizes{};
+        for (auto key : keys) {
+            if (key.empty()) {
+                no_perfect_hash_for_keys();
+            }
+            sizes[bucket_of(sample(key))]++;
+        }
+        // fullest buckets first, while most slots are still free
+        for (size_t size = N; size > 0; --size) {
+            for (size_t bucket = 0; bucket < buckets; ++bucket) {
+                if (sizes[bucket] == size) {
+                    this->place_bucket(bucket);
+                }
+            }
+        }
+    }
+
+    // index of `key` in the key list
+    constexpr std::optional<size_t> find(std::string_view key) const {
+        if (key.empty()) {
+            return std::nullopt;
+        }
+        uint64_t h = sample(key);
+        auto index = this->slots[slot_of(h, this->displacements[bucket_of(h)])];
+        if (index == empty || !equal(this->keys[index], key)) {
+            return std::nullopt;
+        }
+        return index;
+    }
+
+    constexpr size_t size() const { return N; }
+
+private:
+    using index_t = std::conditional_t<(N < UINT8_MAX), uint8_t, uint16_t>;
+    static constexpr index_t empty = static_cast<index_t>(-1);
+    // at most half the slots are used, two to four keys to a bucket
+    static constexpr size_t slot_bits = std::bit_width(std::bit_ceil(N));
+    static constexpr size_t bucket_bits = slot_bits > 2 ? slot_bits - 2 : 0;
+    static constexpr size_t buckets = size_t{1} << bucket_bits;
+
+    static constexpr uint64_t byte(char c) {
+        auto u = static_cast<uint64_t>(static_cast<unsigned char>(c));
+        return fold_case ? u | 0x20 : u;
+    }
+
+    static constexpr char lower(char c) {
+        return fold_case && c >= 'A' && c <= 'Z' ? static_cast<char>(c + ('a' - 'A')) : c;
+    }
+
+    static constexpr bool equal(std::string_view a, std::string_view b) {
+        if (a.size() != b.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); ++i) {
+            if (lower(a[i]) != lower(b[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // odd multiplier, distinct samples stay distinct
+    static constexpr uint64_t sample(std::string_view key) {
+        uint64_t bytes = key.size()
+            | byte(key[0]) << 8
+            | byte(key[key.size() > 1]) << 16
+            | byte(key[key.size() / 2]) << 24
+            | byte(key.back()) << 32;
+        return bytes * 0x9E3779B97F4A7C15;
+    }
+
+    static constexpr size_t bucket_of(uint64_t h) {
+        return bucket_bits == 0 ? 0 : static_cast<size_t>(h >> (64 - bucket_bits));
+    }
+
+    static constexpr size_t slot_of(uint64_t h, uint16_t displacement) {
+        return static_cast<size_t>(((h ^ displacement) * 0xFF51AFD7ED558CCD) >> (64 - slot_bits));
+    }
+
+    consteval void place_bucket(size_t bucket) {
+        for (uint32_t displacement = 0; displacement <= UINT16_MAX; ++displacement) {
+            auto trial = this->slots;
+            bool placed = true;
+            for (size_t i = 0; i < N && placed; ++i) {
+                uint64_t h = sample(this->keys[i]);
+                if (bucket_of(h) != bucket) {
+                    continue;
+                }
+                auto& slot = trial[slot_of(h, static_cast<uint16_t>(displacement))];
+                placed = slot == empty;
+                slot = static_cast<index_t>(i);
+            }
+            if (placed) {
+                this->slots = trial;
+                this->displacements[bucket] = static_cast<uint16_t>(displacement);
+                return;
+            }
+        }
+        // two keys with the same sample, or the same key twice
+        no_perfect_hash_for_keys();
+    }
+
+    std::array<std::string_view, N> keys;
+    std::array<uint16_t, buckets> displacements{};
+    std::array<index_t, size_t{1} << slot_bits> slots{};
+};
+
 template <typename T>
 std::optional<T> enum_from_string(std::string_view str) {
     static_assert(std::is_enum_v<T>, "T must be an enum type");
-    for (auto [index, name] : enum_name_table<T>() | std::views::enumerate) {
-        if (name == str) {
-            return static_cast<T>(index);
-        }
+    static constexpr perfect_hash names{enum_name_table<T>()};
+    if (auto index = names.find(str)) {
+        return static_cast<T>(*index);
     }
-        
     return std::nullopt;
 }
 template <typename T>
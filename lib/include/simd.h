@@ -0,0 +1,53 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+namespace seele::simd {
+
+// Instruction sets the scanners have kernels for, the best one the CPU
+// supports is picked on first use
+enum class isa {
+    scalar,
+    sse42,
+    avx2,
+};
+
+// not constexpr, so a non-ASCII char_class fails to compile
+void non_ascii_char_in_class();
+
+// A set of ASCII characters. Next to the plain table it keeps, for every low
+// nibble, a bitmap of the high nibbles that complete a member: bit (c >> 4)
+// of nibbles[c & 15]. The vector kernels look that up for 16 or 32 bytes at
+// once with two byte shuffles.
+struct char_class {
+    std::array<bool, 256> members{};
+    std::array<uint8_t, 16> nibbles{};
+
+    consteval char_class(std::string_view chars) {
+        for (char c : chars) {
+            auto u = static_cast<unsigned char>(c);
+            if (u >= 128) {
+                non_ascii_char_in_class();
+            }
+            members[u] = true;
+            nibbles[u & 0x0F] |= static_cast<uint8_t>(1u << (u >> 4));
+        }
+    }
+
+    constexpr bool contains(char c) const { return members[static_cast<unsigned char>(c)]; }
+};
+
+isa active_isa();
+
+// Runs the scanners on `target`, or the best the CPU has below it, and
+// returns which one that is. For benchmarks, call it while nothing scans.
+isa force_isa(isa target);
+
+// Position of the first "\r\n" in `str`, npos if there is none
+size_t find_crlf(std::string_view str);
+
+// Length of the longest prefix of `str` made of members of `cls`
+size_t span(std::string_view str, const char_class& cls);
+
+}
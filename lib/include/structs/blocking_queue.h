@@ -0,0 +1,113 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <thread>
+#include <utility>
+#include "parker.h"
+namespace seele::structs {
+
+// Adds blocking pops to one of the lock-free queues. Consumers spin on the
+// queue for a little while, then park on a futex; producers only wake
+// someone when a consumer is actually parked.
+template<typename queue_t>
+class blocking_queue {
+private:
+    // what pop_front() returns, an optional of the item
+    using result_t = decltype(std::declval<queue_t&>().pop_front());
+
+    // rounds of polling before a consumer parks
+    static constexpr int spin_limit = 64;
+
+public:
+    blocking_queue() = default;
+
+    blocking_queue(const blocking_queue&) = delete;
+    blocking_queue& operator=(const blocking_queue&) = delete;
+
+    template<typename item_t>
+    void push_back(item_t&& item) { this->emplace_back(std::forward<item_t>(item)); }
+
+    template<typename... args_t>
+    void emplace_back(args_t&&... args) {
+        this->queue.emplace_back(std::forward<args_t>(args)...);
+        this->waiters.notify_one();
+    }
+
+    result_t pop_front() { return this->queue.pop_front(); }
+
+    // Hands up to `max` items to `fn` without waiting, returns how many
+    template<typename function_t>
+    size_t drain(function_t&& fn, size_t max = SIZE_MAX) {
+        if constexpr (requires { this->queue.drain(fn, max); }) {
+            return this->queue.drain(fn, max);
+        } else {
+            size_t count = 0;
+            while (count < max) {
+                auto item = this->queue.pop_front();
+                if (!item) {
+                    break;
+                }
+                fn(std::move(*item));
+                count++;
+            }
+            return count;
+        }
+    }
+
+    // Waits for an item, or returns nullopt once wake_all() was called
+    result_t pop() {
+        result_t item;
+        this->wait_until([&] {
+            item = this->queue.pop_front();
+            return item.has_value();
+        });
+        return item;
+    }
+
+    // drain() that waits until there is at least one item, returns 0 only
+    // when woken by wake_all()
+    template<typename function_t>
+    size_t wait_drain(function_t&& fn, size_t max = SIZE_MAX) {
+        size_t count = 0;
+        this->wait_until([&] {
+            count = this->drain(fn, max);
+            return count != 0;
+        });
+        return count;
+    }
+
+    // Makes every blocked consumer, and every one after, return empty handed
+    void wake_all() {
+        this->woken.store(true, std::memory_order_release);
+        this->waiters.notify_all();
+    }
+
+private:
+    template<typename predicate_t>
+    void wait_until(predicate_t&& done) {
+        for (int spins = 0; spins < spin_limit; ++spins) {
+            if (done()) {
+                return;
+            }
+            std::this_thread::yield();
+        }
+        while (true) {
+            bool stop = false;
+            this->waiters.park([&] {
+                stop = done() || this->woken.load(std::memory_order_acquire);
+                return stop;
+            });
+            if (stop || done()) {
+                return;
+            }
+        }
+    }
+
+    queue_t queue;
+    parker waiters;
+    std::atomic<bool> woken{false};
+};
+
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+namespace seele::structs {
+
+struct chunk_cache_stats {
+    size_t allocated; // chunks taken from the allocator
+    size_t reused;    // chunks handed out again from the cache
+    size_t freed;     // chunks given back to the allocator because the cache was full
+};
+
+// Bounded freelist of queue chunks. Any thread may acquire or release, every
+// slot is handed over with a single exchange/CAS so there is no ABA to worry
+// about. Once `allocated` stops growing the queue runs without touching the
+// allocator. A CAPACITY of 0 turns recycling off.
+template<typename chunk_t, size_t CAPACITY>
+class chunk_cache {
+public:
+    chunk_cache() {
+        for (auto& slot : this->slots) {
+            slot.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    chunk_cache(const chunk_cache&) = delete;
+    chunk_cache& operator=(const chunk_cache&) = delete;
+
+    ~chunk_cache() {
+        for (auto& slot : this->slots) {
+            delete slot.load(std::memory_order_relaxed);
+        }
+    }
+
+    // A recycled chunk if there is one, a new one otherwise
+    chunk_t* acquire() {
+        for (auto& slot : this->slots) {
+            if (slot.load(std::memory_order_relaxed) == nullptr) {
+                continue;
+            }
+            if (chunk_t* chunk = slot.exchange(nullptr, std::memory_order_acquire)) {
+                this->reused.fetch_add(1, std::memory_order_relaxed);
+                return chunk;
+            }
+        }
+        this->allocated.fetch_add(1, std::memory_order_relaxed);
+        return new chunk_t();
+    }
+
+    // Takes back a drained chunk nobody can reach anymore
+    void release(chunk_t* chunk) {
+        chunk->reset();
+        for (auto& slot : this->slots) {
+            chunk_t* expected = nullptr;
+            if (slot.load(std::memory_order_relaxed) == nullptr
+                && slot.compare_exchange_strong(expected, chunk, std::memory_order_release, std::memory_order_relaxed)) {
+                return;
+            }
+        }
+        this->freed.fetch_add(1, std::memory_order_relaxed);
+        delete chunk;
+    }
+
+    chunk_cache_stats stats() const {
+        return {
+            this->allocated.load(std::memory_order_relaxed),
+            this->reused.load(std::memory_order_relaxed),
+            this->freed.load(std::memory_order_relaxed)
+        };
+    }
+
+private:
+    std::array<std::atomic<chunk_t*>, CAPACITY> slots;
+    std::atomic<size_t> allocated{0};
+    std::atomic<size_t> reused{0};
+    std::atomic<size_t> freed{0};
+};
+
+}
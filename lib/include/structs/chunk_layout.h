@@ -0,0 +1,74 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+namespace seele::structs {
+
+// How a queue chunk lays out its slots and indices.
+enum class chunk_layout {
+    // status next to its payload, several slots and both indices per cache
+    // line. Smallest, but producers writing neighbouring slots and the
+    // consumer advancing read_index all fight over the same lines.
+    // The default, until seele_chunk_bench shows another one winning.
+    packed,
+    // payloads and statuses in separate arrays (SoA), read_index,
+    // write_index and next each on their own line. The consumer polls a
+    // dense status array and never shares a line with the write_index CAS.
+    split,
+    // every slot on its own cache line(s), indices padded too. No two
+    // producers ever touch the same line, at 64 bytes or more per slot.
+    padded,
+};
+
+enum class slot_status : uint8_t {
+    EMPTY,
+    READY,
+    USED
+};
+
+// Payload and status storage of the N slots of a chunk
+template<typename T, size_t N, chunk_layout LAYOUT>
+struct chunk_slots {
+    struct node_t {
+        alignas(T) std::byte storage[sizeof(T)];
+        std::atomic<slot_status> status;
+    };
+    node_t nodes[N];
+
+    std::atomic<slot_status>& status(size_t i) { return nodes[i].status; }
+    void* storage(size_t i) { return &nodes[i].storage; }
+    T& get(size_t i) { return *std::launder(reinterpret_cast<T*>(&nodes[i].storage)); }
+};
+
+template<typename T, size_t N>
+struct chunk_slots<T, N, chunk_layout::split> {
+    struct cell_t {
+        alignas(T) std::byte storage[sizeof(T)];
+    };
+    cell_t cells[N];
+    alignas(64) std::atomic<slot_status> statuses[N];
+
+    std::atomic<slot_status>& status(size_t i) { return statuses[i]; }
+    void* storage(size_t i) { return &cells[i].storage; }
+    T& get(size_t i) { return *std::launder(reinterpret_cast<T*>(&cells[i].storage)); }
+};
+
+template<typename T, size_t N>
+struct chunk_slots<T, N, chunk_layout::padded> {
+    struct alignas(64) alignas(T) node_t {
+        alignas(T) std::byte storage[sizeof(T)];
+        std::atomic<slot_status> status;
+    };
+    node_t nodes[N];
+
+    std::atomic<slot_status>& status(size_t i) { return nodes[i].status; }
+    void* storage(size_t i) { return &nodes[i].storage; }
+    T& get(size_t i) { return *std::launder(reinterpret_cast<T*>(&nodes[i].storage)); }
+};
+
+// Alignment of a chunk's index fields under LAYOUT
+template<chunk_layout LAYOUT>
+constexpr size_t chunk_index_align = LAYOUT == chunk_layout::packed ? alignof(std::atomic<size_t>) : 64;
+
+}
@@ -0,0 +1,137 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "record_registry.h"
+namespace seele::structs {
+
+namespace ebr {
+    constexpr size_t max_retired_count = 64;
+}
+
+// Epoch based reclamation with the interface of hazard_manager, so the
+// queues can take either one.
+// protect() doesn't guard the given pointer but pins the calling thread to
+// the current epoch until every slot it protected is cleared again. A retired
+// pointer is reclaimed once the global epoch is two steps past the one it was
+// retired in, by then every thread that could have seen it has unpinned.
+// Cheaper per access than hazard pointers, but a thread that stays pinned
+// holds back all reclamation.
+class epoch_manager {
+public:
+    static constexpr size_t default_scan_threshold = ebr::max_retired_count;
+
+    // Each thread tries to reclaim its retired pointers every `scan_threshold` retires
+    explicit epoch_manager(size_t scan_threshold = default_scan_threshold);
+
+    epoch_manager(const epoch_manager&) = delete;
+    epoch_manager& operator=(const epoch_manager&) = delete;
+    epoch_manager(epoch_manager&&) = delete;
+    epoch_manager& operator=(epoch_manager&&) = delete;
+
+    ~epoch_manager();
+
+    template<size_t index>
+        requires (index < 64)
+    void protect(void*){
+        auto& record = this->local_record();
+        if (record.held == 0) {
+            this->pin(record);
+        }
+        record.held |= uint64_t{1} << index;
+    }
+
+    template<size_t index>
+        requires (index < 64)
+    void clear(){
+        auto& record = this->local_record();
+        if (record.held == 0) {
+            return;
+        }
+        record.held &= ~(uint64_t{1} << index);
+        if (record.held == 0) {
+            record.epoch.store(0, std::memory_order_release);
+        }
+    }
+
+    void clear_all();
+
+    template<typename T>
+    void retire(T* ptr){
+        this->push_retired(ptr, [](void* p, void*){ delete static_cast<T*>(p); }, nullptr);
+    }
+
+    // Hands `ptr` to `reclaim(owner, ptr)` instead of deleting it
+    template<auto reclaim, typename T, typename owner_t>
+    void retire(T* ptr, owner_t* owner){
+        this->push_retired(ptr, [](void* p, void* o){
+            std::invoke(reclaim, static_cast<owner_t*>(o), static_cast<T*>(p));
+        }, owner);
+    }
+
+    // Pointers retired and not reclaimed yet, over all threads
+    size_t retired_count() const;
+
+private:
+    struct retired_ptr_t {
+        void* ptr;
+        auto (*deleter)(void*, void*) -> void;
+        void* owner;
+        uint64_t epoch;
+    };
+
+    struct alignas(64) epoch_record_t {
+        // (epoch << 1) | 1 while pinned, 0 otherwise
+        std::atomic<uint64_t> epoch{0};
+        std::atomic<bool> active{false};
+        // owner thread only: protect() slots in use
+        uint64_t held = 0;
+        size_t retires_since_scan = 0;
+        // stays with the record when its thread exits, the next owner reclaims it
+        std::vector<retired_ptr_t> retired;
+        // mirrors retired.size() for retired_count(), only the owner writes it
+        std::atomic<size_t> pending{0};
+    };
+
+    struct tls_entry_t {
+        epoch_manager* manager;
+        epoch_record_t* record;
+
+        void release() { this->manager->release_record(this->record); }
+    };
+
+    struct tls_map_t : tls_records<tls_entry_t> {
+        ~tls_map_t();
+    };
+
+    epoch_record_t& local_record() {
+        if (last_id == this->id) {
+            return *last_record;
+        }
+        return this->lookup_record();
+    }
+
+    epoch_record_t& lookup_record();
+    epoch_record_t* allocate_record();
+    void release_record(epoch_record_t* record);
+
+    void pin(epoch_record_t& record);
+    void push_retired(void* ptr, auto (*deleter)(void*, void*) -> void, void* owner);
+    bool try_advance();
+    void collect(epoch_record_t& record);
+
+    // skips the map lookup while a thread keeps using the same manager,
+    // ids start at 1
+    inline static thread_local uint64_t last_id = 0;
+    inline static thread_local epoch_record_t* last_record = nullptr;
+
+    // unique for the life of the process
+    const uint64_t id;
+    size_t scan_threshold;
+    alignas(64) std::atomic<uint64_t> global_epoch{0};
+    record_registry<epoch_record_t> records;
+};
+
+}
@@ -2,20 +2,25 @@
 #include <array>
 #include <atomic>
 #include <cstddef>
-#include <list>
+#include <cstdint>
+#include <functional>
 #include <mutex>
-#include <unordered_map>
+#include <vector>
+#include "record_registry.h"
 namespace seele::structs {
     
 namespace hp {
     constexpr size_t max_hazard_count = 3;
-    constexpr size_t max_thread_count = 64;
     constexpr size_t max_retired_count = 16;    
 }
 
 class hazard_manager {
 public:        
-    hazard_manager() = default;
+    static constexpr size_t default_scan_threshold = hp::max_retired_count;
+
+    // Each thread scans its retired pointers once more than `scan_threshold` pile up
+    explicit hazard_manager(size_t scan_threshold = default_scan_threshold)
+        : id(live_managers::add()), scan_threshold(scan_threshold) {}
 
     hazard_manager(const hazard_manager&) = delete;
     hazard_manager& operator=(const hazard_manager&) = delete;
@@ -43,50 +48,73 @@ public:
 
     template<typename T>
     void retire(T* ptr){
-        this->local_tls().retired_list.emplace_back(ptr, [](void* p){ delete static_cast<T*>(p); });
-        this->scan_tls_retired();
+        this->push_retired(ptr, [](void* p, void*){ delete static_cast<T*>(p); }, nullptr);
     }
 
     template<typename T>
     void retire(T* ptr, auto (*deleter)(void*) -> void){
-        this->local_tls().retired_list.emplace_back(ptr, deleter);
-        this->scan_tls_retired();
+        this->push_retired(ptr, [](void* p, void* d){
+            reinterpret_cast<void (*)(void*)>(d)(p);
+        }, reinterpret_cast<void*>(deleter));
+    }
+
+    // Hands `ptr` to `reclaim(owner, ptr)` instead of deleting it
+    template<auto reclaim, typename T, typename owner_t>
+    void retire(T* ptr, owner_t* owner){
+        this->push_retired(ptr, [](void* p, void* o){
+            std::invoke(reclaim, static_cast<owner_t*>(o), static_cast<T*>(p));
+        }, owner);
     }
+
+    // Pointers retired and not reclaimed yet, over all threads
+    size_t retired_count() const;
 private:    
 
     struct alignas(64) hazard_record_t {
         std::array<std::atomic<void*>, hp::max_hazard_count> hps;
         std::atomic<bool> active;
+        // size of the owner's retired list for retired_count(), only the owner writes it
+        std::atomic<size_t> pending{0};
     };
 
     struct retired_ptr_t {
         void* ptr;
-        auto (*deleter)(void*) -> void;
+        auto (*deleter)(void*, void*) -> void;
+        void* owner;
     };
     
     struct tls_data_t {
+        hazard_manager* manager;
         hazard_record_t* record;
-        std::list<retired_ptr_t> retired_list;
-    };
+        std::vector<retired_ptr_t> retired_list;
+        // scratch space of scan_retired
+        std::vector<void*> hazards;
 
-    struct tls_map_t 
-    :std::unordered_map<hazard_manager*, tls_data_t>
-    {
-        ~tls_map_t();
+        // on thread exit, what is still retired goes to the manager's global list
+        void release();
     };
 
+    using tls_map_t = tls_records<tls_data_t>;
+
     hazard_record_t* allocate_record();
     void deallocate_record(hazard_record_t* record);
 
     tls_data_t& local_tls();
-    void collect_thread_unretired(std::list<retired_ptr_t>& retireds);
+    void collect_thread_unretired(std::vector<retired_ptr_t>& retireds);
 
-    void scan_retired(std::list<retired_ptr_t>& retired_list);
+    void push_retired(void* ptr, auto (*deleter)(void*, void*) -> void, void* owner);
+    void scan_retired(std::vector<retired_ptr_t>& retired_list, std::vector<void*>& hazards);
     void scan_tls_retired();
 
-    std::array<hazard_record_t, hp::max_thread_count> records;
-    std::list<retired_ptr_t> g_retired;
+    // unique for the life of the process
+    const uint64_t id;
+    size_t scan_threshold;
+    record_registry<hazard_record_t> records;
+    std::vector<retired_ptr_t> g_retired;
+    std::vector<void*> g_hazards;
     std::mutex g_retired_mutex;
+    // mirrors g_retired.size(), written under g_retired_mutex
+    std::atomic<size_t> g_pending{0};
 };    
 
 
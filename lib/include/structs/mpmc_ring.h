@@ -0,0 +1,193 @@
+#pragma once
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <optional>
+#include <thread>
+#include <utility>
+namespace seele::structs {
+
+// Bounded multi producer multi consumer queue after Dmitry Vyukov.
+// Every slot carries a sequence number telling whose turn it is: a producer
+// at position p may write the slot once its sequence is p, a consumer may
+// read it once it is p + 1, and hands it back for p + capacity.
+// The slots are allocated once, the queue never touches the allocator after
+// construction and a full queue pushes back on its producers.
+template<typename T>
+class mpmc_ring {
+private:
+    struct alignas(64) slot_t {
+        std::atomic<size_t> sequence;
+        alignas(T) std::byte storage[sizeof(T)];
+        T& get() {
+            return *std::launder(reinterpret_cast<T*>(&storage));
+        }
+    };
+
+    // rounds of checking before a blocking call parks on the slot
+    static constexpr int spin_limit = 64;
+
+public:
+    // capacity is rounded up to a power of two
+    explicit mpmc_ring(size_t capacity)
+        : mask(std::bit_ceil(capacity < 2 ? size_t{2} : capacity) - 1),
+          slots(new slot_t[mask + 1]) {
+        for (size_t i = 0; i <= this->mask; ++i) {
+            this->slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    mpmc_ring(const mpmc_ring&) = delete;
+    mpmc_ring& operator=(const mpmc_ring&) = delete;
+
+    ~mpmc_ring() {
+        while (this->try_pop()) {}
+    }
+
+    size_t capacity() const { return this->mask + 1; }
+
+    // a snapshot, may be stale by the time it returns
+    size_t size() const {
+        size_t head = this->head.load(std::memory_order_relaxed);
+        size_t tail = this->tail.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+    bool try_push(const T& item) { return this->try_emplace(item); }
+
+    bool try_push(T&& item) { return this->try_emplace(std::move(item)); }
+
+    // Fails instead of waiting when the queue is full
+    template<typename... args_t>
+    bool try_emplace(args_t&&... args) {
+        size_t pos = this->tail.load(std::memory_order_relaxed);
+        while (true) {
+            slot_t& slot = this->slots[pos & this->mask];
+            size_t seq = slot.sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (this->tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    this->publish(slot, pos + 1, std::forward<args_t>(args)...);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // the slot still holds the item from a lap ago
+            } else {
+                pos = this->tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void push(const T& item) { this->emplace(item); }
+
+    void push(T&& item) { this->emplace(std::move(item)); }
+
+    // Takes a position unconditionally and waits for its slot to free up
+    template<typename... args_t>
+    void emplace(args_t&&... args) {
+        size_t pos = this->tail.fetch_add(1, std::memory_order_relaxed);
+        slot_t& slot = this->slots[pos & this->mask];
+        this->wait_for(slot, pos);
+        this->publish(slot, pos + 1, std::forward<args_t>(args)...);
+    }
+
+    // Fails instead of waiting when the queue is empty
+    std::optional<T> try_pop() {
+        size_t pos = this->head.load(std::memory_order_relaxed);
+        while (true) {
+            slot_t& slot = this->slots[pos & this->mask];
+            size_t seq = slot.sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (this->head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    return this->consume(slot, pos);
+                }
+            } else if (diff < 0) {
+                return std::nullopt; // nothing written there yet
+            } else {
+                pos = this->head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Takes a position unconditionally and waits for its item to arrive
+    T pop() {
+        size_t pos = this->head.fetch_add(1, std::memory_order_relaxed);
+        slot_t& slot = this->slots[pos & this->mask];
+        this->wait_for(slot, pos + 1);
+        return *this->consume(slot, pos);
+    }
+
+    // Hands up to `max` items to `fn` without waiting, returns how many
+    template<typename function_t>
+    size_t drain(function_t&& fn, size_t max = SIZE_MAX) {
+        size_t count = 0;
+        while (count < max) {
+            auto item = this->try_pop();
+            if (!item) {
+                break;
+            }
+            fn(std::move(*item));
+            count++;
+        }
+        return count;
+    }
+
+private:
+    template<typename... args_t>
+    void publish(slot_t& slot, size_t sequence, args_t&&... args) {
+        new (&slot.storage) T(std::forward<args_t>(args)...);
+        slot.sequence.store(sequence, std::memory_order_release);
+        this->wake(slot);
+    }
+
+    std::optional<T> consume(slot_t& slot, size_t pos) {
+        std::optional<T> result{std::move(slot.get())};
+        slot.get().~T();
+        slot.sequence.store(pos + this->mask + 1, std::memory_order_release);
+        this->wake(slot);
+        return result;
+    }
+
+    // Only pays for the syscall if some blocking call is parked, on any slot
+    void wake(slot_t& slot) {
+        // pairs with the fence in wait_for(), one of the two sides sees the other
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (this->parked.load(std::memory_order_relaxed) != 0) {
+            slot.sequence.notify_all();
+        }
+    }
+
+    // Spins a little, then parks until the slot reaches `sequence`.
+    // Several laps may share the slot, so wait for a change, not a value.
+    void wait_for(slot_t& slot, size_t sequence) {
+        int spins = 0;
+        while (true) {
+            size_t seq = slot.sequence.load(std::memory_order_acquire);
+            if (seq == sequence) {
+                return;
+            }
+            if (++spins < spin_limit) {
+                std::this_thread::yield();
+                continue;
+            }
+            this->parked.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            // a store after `seq` was read either shows up here or sees us parked
+            slot.sequence.wait(seq, std::memory_order_acquire);
+            this->parked.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+    // blocking calls asleep in wait_for()
+    alignas(64) std::atomic<uint32_t> parked{0};
+    alignas(64) const size_t mask;
+    std::unique_ptr<slot_t[]> slots;
+};
+
+}
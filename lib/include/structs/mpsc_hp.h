@@ -2,19 +2,26 @@
 #include <array>
 #include <atomic>
 #include <cstddef>
-#include <list>
+#include <cstdint>
+#include <functional>
 #include <mutex>
-#include <unordered_map>
+#include <vector>
+#include "record_registry.h"
 namespace seele::structs {
 namespace mpsc_hp {
     constexpr size_t max_hazard_count = 2;
-    constexpr size_t max_thread_count = 64;
     constexpr size_t max_retired_count = 64*16;    
 }
 
 class mpsc_hazard_manager{
 public:
-    mpsc_hazard_manager() = default;
+    static constexpr size_t default_scan_threshold = mpsc_hp::max_retired_count;
+
+    // Retired pointers are scanned once more than `scan_threshold` pile up
+    explicit mpsc_hazard_manager(size_t scan_threshold = default_scan_threshold)
+        : id(live_managers::add()), scan_threshold(scan_threshold) {
+        this->retired.reserve(scan_threshold + 1);
+    }
     mpsc_hazard_manager(const mpsc_hazard_manager&) = delete;       
     mpsc_hazard_manager& operator=(const mpsc_hazard_manager&) = delete;
     mpsc_hazard_manager(mpsc_hazard_manager&&) = delete;
@@ -42,12 +49,20 @@ public:
 
     template<typename T>
     void retire(T* ptr){
-        this->retired.emplace_back(ptr, [](void* p){ delete static_cast<T*>(p); });
-        if (this->retired.size() > mpsc_hp::max_retired_count) {
-            this->scan_retired();
-        }
+        this->push_retired(ptr, [](void* p, void*){ delete static_cast<T*>(p); }, nullptr);
     }
 
+    // Hands `ptr` to `reclaim(owner, ptr)` instead of deleting it
+    template<auto reclaim, typename T, typename owner_t>
+    void retire(T* ptr, owner_t* owner){
+        this->push_retired(ptr, [](void* p, void* o){
+            std::invoke(reclaim, static_cast<owner_t*>(o), static_cast<T*>(p));
+        }, owner);
+    }
+
+    // Pointers retired and not reclaimed yet, safe to read from any thread
+    size_t retired_count() const { return this->pending.load(std::memory_order_relaxed); }
+
 private:
     struct alignas(64) hazard_record_t {
         std::array<std::atomic<void*>, mpsc_hp::max_hazard_count> hps;
@@ -56,17 +71,40 @@ private:
 
     struct retired_ptr_t {
         void* ptr;
-        auto (*deleter)(void*) -> void;
+        auto (*deleter)(void*, void*) -> void;
+        void* owner;
     };
-    using tls_map_t = std::unordered_map<mpsc_hazard_manager*, hazard_record_t*>; 
+    // hands the record back when its thread exits
+    struct tls_entry_t {
+        mpsc_hazard_manager* manager;
+        hazard_record_t* record;
+
+        void release();
+    };
+
+    using tls_map_t = tls_records<tls_entry_t>;
     hazard_record_t* allocate_record();
     inline void deallocate_record(hazard_record_t* record);
+    void push_retired(void* ptr, auto (*deleter)(void*, void*) -> void, void* owner) {
+        this->retired.emplace_back(ptr, deleter, owner);
+        this->pending.store(this->retired.size(), std::memory_order_relaxed);
+        if (this->retired.size() > this->scan_threshold) {
+            this->scan_retired();
+        }
+    }
     void scan_retired();
     hazard_record_t* local_tls();
     
 
 
-    std::array<hazard_record_t, mpsc_hp::max_thread_count> records;
-    std::list<retired_ptr_t> retired;
+    record_registry<hazard_record_t> records;
+    // unique for the life of the process
+    const uint64_t id;
+    size_t scan_threshold;
+    std::vector<retired_ptr_t> retired;
+    // scratch space of scan_retired, only the consumer scans
+    std::vector<void*> hazards;
+    // mirrors retired.size() for other threads
+    std::atomic<size_t> pending{0};
 };
 }
\ No newline at end of file
@@ -3,65 +3,87 @@
 #include <cstddef>
 #include <memory>
 #include <optional>
+#include <span>
+#include <cstdint>
 #include <thread>
 #include <ranges>
 #include <algorithm>
 #include <utility>
+#include "chunk_cache.h"
+#include "chunk_layout.h"
+#include "ebr.h"
 #include "mpsc_hp.h"
 namespace seele::structs {
 
 
-template<typename T, size_t MAX_NODES = 64>
+template<typename T, size_t MAX_NODES = 64, chunk_layout LAYOUT = chunk_layout::packed>
 struct mpsc_chunk{
-    enum status_t {
-        EMPTY,
-        READY,
-        USED
-    };
-    struct node_t{
-        alignas(T) std::byte storage[sizeof(T)];
-        std::atomic<status_t> status;
-        T& get() {
-            return *std::launder(reinterpret_cast<T*>(&storage));
-        }
-        node_t() : storage{}, status(EMPTY) {}
-    };
-    node_t data[MAX_NODES];
-    size_t read_index;
-    std::atomic<size_t> write_index;
-    std::atomic<mpsc_chunk*> next;
+    using enum slot_status;
+    static constexpr size_t index_align = chunk_index_align<LAYOUT>;
+
+    chunk_slots<T, MAX_NODES, LAYOUT> data;
+    alignas(index_align) size_t read_index;
+    alignas(index_align) std::atomic<size_t> write_index;
+    alignas(index_align) std::atomic<mpsc_chunk*> next;
     mpsc_chunk() : data{}, read_index(0), write_index(0), next(nullptr) {}
 
     std::optional<T> pop_front();
 
+    // Hands up to `max` items to `fn`, stopping early at one whose
+    // producer hasn't finished writing it instead of waiting for it
+    template<typename function_t>
+    size_t drain(function_t& fn, size_t max);
+
     template<typename... args_t>
     bool emplace_back(args_t&&... args);
 
+    // Makes a drained chunk usable again
+    void reset();
+
     ~mpsc_chunk();
 };
 
-template<typename T, size_t MAX_NODES>
-std::optional<T> mpsc_chunk<T, MAX_NODES>::pop_front(){
+template<typename T, size_t MAX_NODES, chunk_layout LAYOUT>
+std::optional<T> mpsc_chunk<T, MAX_NODES, LAYOUT>::pop_front(){
     size_t write_idx = write_index.load(std::memory_order_acquire);
     if (this->read_index >= write_idx) {
         return std::nullopt; // no elements to pop
     }
 
     
-    while (data[this->read_index].status.load(std::memory_order_acquire) != READY) {
+    while (data.status(this->read_index).load(std::memory_order_acquire) != READY) {
         // wait until the data is ready
     }
 
-    T result = std::move(data[this->read_index].get());
-    data[this->read_index].get().~T();
-    data[this->read_index].status.store(USED, std::memory_order_release);
+    T result = std::move(data.get(this->read_index));
+    data.get(this->read_index).~T();
+    data.status(this->read_index).store(USED, std::memory_order_release);
     this->read_index++;
     return result;
 }
 
-template<typename T, size_t MAX_NODES>
+template<typename T, size_t MAX_NODES, chunk_layout LAYOUT>
+template<typename function_t>
+size_t mpsc_chunk<T, MAX_NODES, LAYOUT>::drain(function_t& fn, size_t max){
+    size_t write_idx = std::min(write_index.load(std::memory_order_acquire), MAX_NODES);
+    size_t count = 0;
+    while (count < max && this->read_index < write_idx) {
+        size_t i = this->read_index;
+        if (data.status(i).load(std::memory_order_acquire) != READY) {
+            break;
+        }
+        fn(std::move(data.get(i)));
+        data.get(i).~T();
+        data.status(i).store(USED, std::memory_order_release);
+        this->read_index++;
+        count++;
+    }
+    return count;
+}
+
+template<typename T, size_t MAX_NODES, chunk_layout LAYOUT>
 template<typename... args_t>
-bool mpsc_chunk<T, MAX_NODES>::emplace_back(args_t&&... args) {
+bool mpsc_chunk<T, MAX_NODES, LAYOUT>::emplace_back(args_t&&... args) {
 
     while (true) {
         size_t write_idx = write_index.load(std::memory_order_acquire);
@@ -70,24 +92,43 @@ bool mpsc_chunk<T, MAX_NODES>::emplace_back(args_t&&... args) {
         }
         if (this->write_index.compare_exchange_strong(write_idx, write_idx + 1, std::memory_order_release, std::memory_order_relaxed)){
             // construct new value in place
-            new (&data[write_idx].storage) T(std::forward<args_t>(args)...);
-            data[write_idx].status.store(READY, std::memory_order_release);
+            new (data.storage(write_idx)) T(std::forward<args_t>(args)...);
+            data.status(write_idx).store(READY, std::memory_order_release);
             return true; // successfully added
         }
     }
 }
-template<typename T, size_t MAX_NODES>
-mpsc_chunk<T, MAX_NODES>::~mpsc_chunk(){
+template<typename T, size_t MAX_NODES, chunk_layout LAYOUT>
+void mpsc_chunk<T, MAX_NODES, LAYOUT>::reset(){
+    for (size_t i = 0; i < MAX_NODES; ++i) {
+        data.status(i).store(EMPTY, std::memory_order_relaxed);
+    }
+    read_index = 0;
+    write_index.store(0, std::memory_order_relaxed);
+    next.store(nullptr, std::memory_order_relaxed);
+}
+
+template<typename T, size_t MAX_NODES, chunk_layout LAYOUT>
+mpsc_chunk<T, MAX_NODES, LAYOUT>::~mpsc_chunk(){
     for (size_t i = read_index; i < write_index; ++i) {
-        data[i].get().~T(); // call destructor if the data was constructed
+        data.get(i).~T(); // call destructor if the data was constructed
     }
 };
 
 
-template <typename T, size_t N = 64>
+// N is the number of items per chunk, CACHE the number of drained chunks
+// kept around for reuse instead of going back to the allocator.
+// reclaimer_t is mpsc_hazard_manager or epoch_manager, LAYOUT picks the chunk layout.
+template <typename T, size_t N = 64, size_t CACHE = 16, typename reclaimer_t = mpsc_hazard_manager,
+          chunk_layout LAYOUT = chunk_layout::packed>
 class mpsc_queue {
 private:
-    using chunk_t = mpsc_chunk<T, N>;
+    using chunk_t = mpsc_chunk<T, N, LAYOUT>;
+    using cache_t = chunk_cache<chunk_t, CACHE>;
+
+    // Scanning after CACHE/2 retirements lets the cache take every chunk the
+    // scan frees while still holding the ones from the last round
+    static constexpr size_t scan_threshold = CACHE >= 2 ? CACHE / 2 - 1 : reclaimer_t::default_scan_threshold;
 
 public:
     mpsc_queue();
@@ -101,24 +142,40 @@ public:
     void emplace_back(args_t&&... args);
     
     std::optional<T> pop_front();
-    
+
+    // Hands every item that is ready to `fn` in order, across chunks, and
+    // returns how many. Single consumer like pop_front().
+    template<typename function_t>
+    size_t drain(function_t&& fn, size_t max = SIZE_MAX);
+
+    // Moves up to out.size() ready items into `out`, returns how many
+    size_t pop_bulk(std::span<T> out) {
+        size_t count = 0;
+        return this->drain([&](T&& item) { out[count++] = std::move(item); }, out.size());
+    }
+
+    chunk_cache_stats stats() const { return this->cache.stats(); }
+
+    const reclaimer_t& reclaimer() const { return this->hp; }
 
 private:
     alignas(64) chunk_t* head_chunk;
     alignas(64) std::atomic<chunk_t*> tail_chunk;
-    alignas(64) mpsc_hazard_manager hp;
+    // declared before hp, whose destructor still hands chunks back to it
+    alignas(64) cache_t cache;
+    alignas(64) reclaimer_t hp;
 };
 
 
-template <typename T, size_t N>
-mpsc_queue<T, N>::mpsc_queue(){
-    chunk_t* dummy = new chunk_t();
+template <typename T, size_t N, size_t CACHE, typename reclaimer_t, chunk_layout LAYOUT>
+mpsc_queue<T, N, CACHE, reclaimer_t, LAYOUT>::mpsc_queue() : hp(scan_threshold) {
+    chunk_t* dummy = this->cache.acquire();
     head_chunk = dummy;
     tail_chunk.store(dummy, std::memory_order_relaxed);
 }
 
-template <typename T, size_t N>
-mpsc_queue<T, N>::~mpsc_queue() {
+template <typename T, size_t N, size_t CACHE, typename reclaimer_t, chunk_layout LAYOUT>
+mpsc_queue<T, N, CACHE, reclaimer_t, LAYOUT>::~mpsc_queue() {
     chunk_t* current = head_chunk;
     while (current) {
         chunk_t* next = current->next.load(std::memory_order_relaxed);
@@ -127,9 +184,9 @@ mpsc_queue<T, N>::~mpsc_queue() {
     }
 }
 
-template <typename T, size_t N>
+template <typename T, size_t N, size_t CACHE, typename reclaimer_t, chunk_layout LAYOUT>
 template<typename... args_t>
-void mpsc_queue<T, N>::emplace_back(args_t&&... args) {
+void mpsc_queue<T, N, CACHE, reclaimer_t, LAYOUT>::emplace_back(args_t&&... args) {
 
     constexpr std::size_t HAZ_TAIL = 0;
 
@@ -137,22 +194,24 @@ void mpsc_queue<T, N>::emplace_back(args_t&&... args) {
     
     while (true) {
         chunk_t* old_tail = this->tail_chunk.load(std::memory_order_acquire);
-        hp.protect<HAZ_TAIL>(old_tail);
+        hp.template protect<HAZ_TAIL>(old_tail);
         if (old_tail != this->tail_chunk.load(std::memory_order_acquire)) {
             continue; // Tail was updated, retry
         }
         if (old_tail->emplace_back(std::forward<args_t>(args)...)) {
-            hp.clear<HAZ_TAIL>();
+            hp.template clear<HAZ_TAIL>();
             return; // successfully added
         }
 
         // If we reach here, it means the current chunk is full
         // We need to create a new chunk and link it
         
-        chunk_t* new_chunk = new chunk_t();                
         auto next = old_tail->next.load(std::memory_order_acquire);
 
         if (next == nullptr) {
+            chunk_t* new_chunk = this->cache.acquire();
+            // the tail is published with release too, a producer may reach
+            // the new chunk through it rather than through next
             if (old_tail->next.compare_exchange_strong(
                 next, new_chunk,
                 std::memory_order_release,
@@ -160,30 +219,27 @@ void mpsc_queue<T, N>::emplace_back(args_t&&... args) {
             )) {
                 this->tail_chunk.compare_exchange_strong(
                     old_tail, new_chunk,
-                    std::memory_order_relaxed,
+                    std::memory_order_release,
                     std::memory_order_relaxed
                 );
-                hp.clear<HAZ_TAIL>();                     
+                hp.template clear<HAZ_TAIL>();                     
                 continue; // successfully linked new chunk
             }
-
+            this->cache.release(new_chunk); // lost the race, it was never visible
         }
         // Tail was not the last node, so we need to update it
         this->tail_chunk.compare_exchange_strong(
             old_tail, next,
-            std::memory_order_relaxed,
+            std::memory_order_release,
             std::memory_order_relaxed
         );
-        hp.clear<HAZ_TAIL>(); 
-                        
-        
-        delete new_chunk; // clean up the new chunk if it was not used
+        hp.template clear<HAZ_TAIL>(); 
     }
 }
 
 
-template <typename T, size_t N>
-std::optional<T> mpsc_queue<T, N>::pop_front() {
+template <typename T, size_t N, size_t CACHE, typename reclaimer_t, chunk_layout LAYOUT>
+std::optional<T> mpsc_queue<T, N, CACHE, reclaimer_t, LAYOUT>::pop_front() {
     
     while (true) {
         chunk_t* dummy = this->head_chunk;
@@ -211,7 +267,7 @@ std::optional<T> mpsc_queue<T, N>::pop_front() {
         }                          
 
         head_chunk = next;
-        hp.retire(dummy); // retire the old head chunk
+        hp.template retire<&cache_t::release>(dummy, &this->cache); // retire the old head chunk
         // successfully updated head        
     }
 
@@ -219,4 +275,33 @@ std::optional<T> mpsc_queue<T, N>::pop_front() {
 
 
 
+template <typename T, size_t N, size_t CACHE, typename reclaimer_t, chunk_layout LAYOUT>
+template<typename function_t>
+size_t mpsc_queue<T, N, CACHE, reclaimer_t, LAYOUT>::drain(function_t&& fn, size_t max) {
+    size_t count = 0;
+    while (count < max) {
+        chunk_t* dummy = this->head_chunk;
+        count += dummy->drain(fn, max - count);
+        if (dummy->read_index < N) {
+            break; // nothing more written yet, or the next item is still being written
+        }
+
+        chunk_t* next = dummy->next.load(std::memory_order_acquire);
+        if (next == nullptr) {
+            break;
+        }
+        chunk_t* tail_now = tail_chunk.load(std::memory_order_acquire);
+        if (tail_now == dummy) {        
+            tail_chunk.compare_exchange_strong(     
+                tail_now, next,
+                std::memory_order_release,
+                std::memory_order_relaxed);
+        }                          
+
+        head_chunk = next;
+        hp.template retire<&cache_t::release>(dummy, &this->cache);
+    }
+    return count;
+}
+
 }
\ No newline at end of file
@@ -2,9 +2,11 @@
 #include <atomic>
 #include <memory>
 #include <optional>
+#include "ebr.h"
 #include "hp.h"
 namespace seele::structs {
-template <typename T>
+// reclaimer_t is hazard_manager or epoch_manager
+template <typename T, typename reclaimer_t = hazard_manager>
 class ms_queue {
 private:
     struct node_t{
@@ -32,22 +34,24 @@ public:
     
     std::optional<T> pop_front();
 
+    const reclaimer_t& reclaimer() const { return this->hp; }
+
 private:
     alignas(64) std::atomic<node_t*> head;
     alignas(64) std::atomic<node_t*> tail;
-    alignas(64) hazard_manager hp;
+    alignas(64) reclaimer_t hp;
 };
 
 
-template <typename T>
-ms_queue<T>::ms_queue(){
+template <typename T, typename reclaimer_t>
+ms_queue<T, reclaimer_t>::ms_queue(){
     node_t* dummy = new node_t();
     head.store(dummy, std::memory_order_relaxed);
     tail.store(dummy, std::memory_order_relaxed);
 }
 
-template <typename T>
-ms_queue<T>::~ms_queue() {
+template <typename T, typename reclaimer_t>
+ms_queue<T, reclaimer_t>::~ms_queue() {
     node_t* current = head.load(std::memory_order_relaxed);
     while (current) {
         node_t* next = current->next.load(std::memory_order_relaxed);
@@ -56,14 +60,14 @@ ms_queue<T>::~ms_queue() {
     }
 }
 
-template <typename T>
+template <typename T, typename reclaimer_t>
 template<typename... args_t>
-void ms_queue<T>::emplace_back(args_t&&... args) {
+void ms_queue<T, reclaimer_t>::emplace_back(args_t&&... args) {
     constexpr std::size_t HAZ_TAIL = 0;
     node_t* new_node = new node_t(std::forward<args_t>(args)...);
     while (true) {
         auto old_tail = this->tail.load(std::memory_order_acquire);
-        hp.protect<HAZ_TAIL>(old_tail);  
+        hp.template protect<HAZ_TAIL>(old_tail);  
             
         if (old_tail != this->tail.load(std::memory_order_acquire)) {
             continue; // Tail was updated, retry
@@ -78,38 +82,38 @@ void ms_queue<T>::emplace_back(args_t&&... args) {
             )) {
                 this->tail.compare_exchange_strong(
                     old_tail, new_node,
-                    std::memory_order_relaxed,
+                    std::memory_order_release,
                     std::memory_order_relaxed
                 );
-                hp.clear<HAZ_TAIL>();                     
+                hp.template clear<HAZ_TAIL>();                     
                 return;
             }
         } else {
             // Tail was not the last node, so we need to update it
             this->tail.compare_exchange_strong(
                 old_tail, next,
-                std::memory_order_relaxed,
+                std::memory_order_release,
                 std::memory_order_relaxed
             );
-            hp.clear<HAZ_TAIL>(); 
+            hp.template clear<HAZ_TAIL>(); 
         }
     }
 }
 
-template <typename T>
-std::optional<T> ms_queue<T>::pop_front() {
+template <typename T, typename reclaimer_t>
+std::optional<T> ms_queue<T, reclaimer_t>::pop_front() {
     constexpr std::size_t HAZ_HEAD = 0;
     constexpr std::size_t HAZ_NEXT = 1;
 
     while (true) {
         node_t* dummy = this->head.load(std::memory_order_acquire);
-        hp.protect<HAZ_HEAD>(dummy);
+        hp.template protect<HAZ_HEAD>(dummy);
 
         if (dummy != this->head.load(std::memory_order_acquire))
             continue;
 
         node_t* next = dummy->next.load(std::memory_order_acquire);
-        hp.protect<HAZ_NEXT>(next);
+        hp.template protect<HAZ_NEXT>(next);
 
 
         if (next == nullptr) {
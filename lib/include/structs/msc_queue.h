@@ -6,29 +6,21 @@
 #include <optional>
 #include <algorithm>
 #include <utility>
+#include "chunk_cache.h"
+#include "chunk_layout.h"
+#include "ebr.h"
 #include "hp.h" 
 namespace seele::structs {
 
-template<typename T, size_t MAX_NODES = 64>
-struct msc_chunk{            
-    enum status_t {
-        EMPTY,
-        READY,
-        USED
-    };
-    struct node_t{
-        alignas(T) std::byte storage[sizeof(T)];
-        std::atomic<status_t> status;
-        T& get() {
-            return *std::launder(reinterpret_cast<T*>(&storage));
-        }
-        node_t() : storage{}, status(EMPTY) {}
-    };
+template<typename T, size_t MAX_NODES = 64, chunk_layout LAYOUT = chunk_layout::packed>
+struct msc_chunk{
+    using enum slot_status;
+    static constexpr size_t index_align = chunk_index_align<LAYOUT>;
 
-    node_t data[MAX_NODES];
-    std::atomic<size_t> read_index;
-    std::atomic<size_t> write_index;
-    std::atomic<msc_chunk*> next;
+    chunk_slots<T, MAX_NODES, LAYOUT> data;
+    alignas(index_align) std::atomic<size_t> read_index;
+    alignas(index_align) std::atomic<size_t> write_index;
+    alignas(index_align) std::atomic<msc_chunk*> next;
     msc_chunk() : data{}, read_index(0), write_index(0), next(nullptr) {}
 
     std::optional<T> pop_front();
@@ -36,11 +28,14 @@ struct msc_chunk{
     template<typename... args_t>
     bool emplace_back(args_t&&... args);
 
+    // Makes a drained chunk usable again
+    void reset();
+
     ~msc_chunk();
 };
 
-template<typename T, size_t MAX_NODES>
-std::optional<T> msc_chunk<T, MAX_NODES>::pop_front(){
+template<typename T, size_t MAX_NODES, chunk_layout LAYOUT>
+std::optional<T> msc_chunk<T, MAX_NODES, LAYOUT>::pop_front(){
     while (true) {
         size_t read_idx = read_index.load(std::memory_order_acquire);
         size_t write_idx = write_index.load(std::memory_order_acquire);
@@ -49,22 +44,22 @@ std::optional<T> msc_chunk<T, MAX_NODES>::pop_front(){
         }
 
         if (this->read_index.compare_exchange_strong(read_idx, read_idx + 1, std::memory_order_release, std::memory_order_relaxed)) {
-            while (data[read_idx].status.load(std::memory_order_acquire) != READY) {
+            while (data.status(read_idx).load(std::memory_order_acquire) != READY) {
                 // wait until the data is ready
             }
 
-            T result = std::move(data[read_idx].get());
-            data[read_idx].get().~T();
-            data[read_idx].status.store(USED, std::memory_order_release);
+            T result = std::move(data.get(read_idx));
+            data.get(read_idx).~T();
+            data.status(read_idx).store(USED, std::memory_order_release);
             return result;
         }                
     }
 
 }
 
-template<typename T, size_t MAX_NODES>
+template<typename T, size_t MAX_NODES, chunk_layout LAYOUT>
 template<typename... args_t>
-bool msc_chunk<T, MAX_NODES>::emplace_back(args_t&&... args) {
+bool msc_chunk<T, MAX_NODES, LAYOUT>::emplace_back(args_t&&... args) {
 
     while (true) {
         size_t write_idx = write_index.load(std::memory_order_acquire);
@@ -73,24 +68,42 @@ bool msc_chunk<T, MAX_NODES>::emplace_back(args_t&&... args) {
         }
         if (this->write_index.compare_exchange_strong(write_idx, write_idx + 1, std::memory_order_release, std::memory_order_relaxed)){
             // construct new value in place
-            new (&data[write_idx].storage) T(std::forward<args_t>(args)...);
-            data[write_idx].status.store(READY, std::memory_order_release);
+            new (data.storage(write_idx)) T(std::forward<args_t>(args)...);
+            data.status(write_idx).store(READY, std::memory_order_release);
             return true; // successfully added
         }
     }
 }
-template<typename T, size_t MAX_NODES>
-msc_chunk<T, MAX_NODES>::~msc_chunk(){
+template<typename T, size_t MAX_NODES, chunk_layout LAYOUT>
+void msc_chunk<T, MAX_NODES, LAYOUT>::reset(){
+    for (size_t i = 0; i < MAX_NODES; ++i) {
+        data.status(i).store(EMPTY, std::memory_order_relaxed);
+    }
+    read_index.store(0, std::memory_order_relaxed);
+    write_index.store(0, std::memory_order_relaxed);
+    next.store(nullptr, std::memory_order_relaxed);
+}
+
+template<typename T, size_t MAX_NODES, chunk_layout LAYOUT>
+msc_chunk<T, MAX_NODES, LAYOUT>::~msc_chunk(){
     for (size_t i = read_index; i < write_index; ++i) {
-        data[i].get().~T(); // call destructor if the data was constructed
+        data.get(i).~T(); // call destructor if the data was constructed
     }
 };
 
 
-template <typename T, size_t N = 64>
+// N is the number of items per chunk, CACHE the number of drained chunks
+// kept around for reuse instead of going back to the allocator.
+// reclaimer_t is hazard_manager or epoch_manager, LAYOUT picks the chunk layout.
+template <typename T, size_t N = 64, size_t CACHE = 16, typename reclaimer_t = hazard_manager,
+          chunk_layout LAYOUT = chunk_layout::packed>
 class msc_queue {
 private:
-    using chunk_t = msc_chunk<T, N>;
+    using chunk_t = msc_chunk<T, N, LAYOUT>;
+    using cache_t = chunk_cache<chunk_t, CACHE>;
+
+    // see mpsc_queue, here the threshold holds per consumer thread
+    static constexpr size_t scan_threshold = CACHE >= 2 ? CACHE / 2 - 1 : reclaimer_t::default_scan_threshold;
 
 public:
     msc_queue();
@@ -105,22 +118,28 @@ public:
     
     std::optional<T> pop_front();
 
+    chunk_cache_stats stats() const { return this->cache.stats(); }
+
+    const reclaimer_t& reclaimer() const { return this->hp; }
+
 private:
     alignas(64) std::atomic<chunk_t*> head_chunk;
     alignas(64) std::atomic<chunk_t*> tail_chunk;
-    alignas(64) hazard_manager hp;
+    // declared before hp, whose destructor still hands chunks back to it
+    alignas(64) cache_t cache;
+    alignas(64) reclaimer_t hp;
 };
 
 
-template <typename T, size_t N>
-msc_queue<T, N>::msc_queue(){
-    chunk_t* dummy = new chunk_t();
+template <typename T, size_t N, size_t CACHE, typename reclaimer_t, chunk_layout LAYOUT>
+msc_queue<T, N, CACHE, reclaimer_t, LAYOUT>::msc_queue() : hp(scan_threshold) {
+    chunk_t* dummy = this->cache.acquire();
     head_chunk.store(dummy, std::memory_order_relaxed);
     tail_chunk.store(dummy, std::memory_order_relaxed);
 }
 
-template <typename T, size_t N>
-msc_queue<T, N>::~msc_queue() {
+template <typename T, size_t N, size_t CACHE, typename reclaimer_t, chunk_layout LAYOUT>
+msc_queue<T, N, CACHE, reclaimer_t, LAYOUT>::~msc_queue() {
     chunk_t* current = head_chunk.load(std::memory_order_relaxed);
     while (current) {
         chunk_t* next = current->next.load(std::memory_order_relaxed);
@@ -129,9 +148,9 @@ msc_queue<T, N>::~msc_queue() {
     }
 }
 
-template <typename T, size_t N>
+template <typename T, size_t N, size_t CACHE, typename reclaimer_t, chunk_layout LAYOUT>
 template<typename... args_t>
-void msc_queue<T, N>::emplace_back(args_t&&... args) {
+void msc_queue<T, N, CACHE, reclaimer_t, LAYOUT>::emplace_back(args_t&&... args) {
 
     constexpr std::size_t HAZ_TAIL = 0;
 
@@ -139,25 +158,22 @@ void msc_queue<T, N>::emplace_back(args_t&&... args) {
     
     while (true) {
         chunk_t* old_tail = this->tail_chunk.load(std::memory_order_acquire);
-        hp.protect<HAZ_TAIL>(old_tail);
+        hp.template protect<HAZ_TAIL>(old_tail);
         if (old_tail != this->tail_chunk.load(std::memory_order_acquire)) {
             continue; // Tail was updated, retry
         }
         if (old_tail->emplace_back(std::forward<args_t>(args)...)) {
-            hp.clear<HAZ_TAIL>();
+            hp.template clear<HAZ_TAIL>();
             return; // successfully added
         }
 
         // If we reach here, it means the current chunk is full
         // We need to create a new chunk and link it
 
-        static thread_local std::unique_ptr<chunk_t> local_cache = std::make_unique<chunk_t>();
-
-        chunk_t* new_chunk = local_cache.get();
-
         auto next = old_tail->next.load(std::memory_order_acquire);
 
         if (next == nullptr) {
+            chunk_t* new_chunk = this->cache.acquire();
             if (old_tail->next.compare_exchange_strong(
                 next, new_chunk,
                 std::memory_order_release,
@@ -165,45 +181,42 @@ void msc_queue<T, N>::emplace_back(args_t&&... args) {
             )) {
                 this->tail_chunk.compare_exchange_strong(
                     old_tail, new_chunk,
-                    std::memory_order_relaxed,
+                    std::memory_order_release,
                     std::memory_order_relaxed
                 );
-                hp.clear<HAZ_TAIL>(); 
-                // successfully linked new chunk
-                // release the local cache
-                // and reset it
-                local_cache.release();
-                local_cache = std::make_unique<chunk_t>();       
-                continue;
+                hp.template clear<HAZ_TAIL>(); 
+                continue; // successfully linked new chunk
             }
-
+            this->cache.release(new_chunk); // lost the race, it was never visible
         }
         // Tail was not the last node, so we need to update it
         this->tail_chunk.compare_exchange_strong(
             old_tail, next,
-            std::memory_order_relaxed,
+            std::memory_order_release,
             std::memory_order_relaxed
         );
-        hp.clear<HAZ_TAIL>(); 
+        hp.template clear<HAZ_TAIL>(); 
                         
     }
 }
 
-template <typename T, size_t N>
-std::optional<T> msc_queue<T, N>::pop_front() {
+template <typename T, size_t N, size_t CACHE, typename reclaimer_t, chunk_layout LAYOUT>
+std::optional<T> msc_queue<T, N, CACHE, reclaimer_t, LAYOUT>::pop_front() {
     constexpr std::size_t HAZ_HEAD = 0;
     constexpr std::size_t HAZ_NEXT = 1;
 
     while (true) {
         chunk_t* dummy = this->head_chunk.load(std::memory_order_acquire);
-        hp.protect<HAZ_HEAD>(dummy);
+        hp.template protect<HAZ_HEAD>(dummy);
 
         if (dummy != this->head_chunk.load(std::memory_order_acquire))
             continue;
 
         auto res = dummy->pop_front();
         if (res) {
-            hp.clear<HAZ_HEAD>();
+            // HAZ_NEXT may be left over from an earlier round, an epoch
+            // manager would stay pinned on it
+            hp.clear_all();
             return res; // successfully popped
         }
 
@@ -211,7 +224,7 @@ std::optional<T> msc_queue<T, N>::pop_front() {
         // We need to update the head and possibly the tail
 
         chunk_t* next = dummy->next.load(std::memory_order_acquire);
-        hp.protect<HAZ_NEXT>(next);
+        hp.template protect<HAZ_NEXT>(next);
 
         if (next == nullptr) {
             hp.clear_all();
@@ -234,9 +247,9 @@ std::optional<T> msc_queue<T, N>::pop_front() {
         if (head_chunk.compare_exchange_strong(dummy, next,
                                         std::memory_order_release,
                                         std::memory_order_relaxed)) {
-            hp.clear<HAZ_HEAD>();
-            hp.clear<HAZ_NEXT>();
-            hp.retire(dummy);
+            hp.template clear<HAZ_HEAD>();
+            hp.template clear<HAZ_NEXT>();
+            hp.template retire<&cache_t::release>(dummy, &this->cache);
             // successfully updated head
         }
     }
@@ -0,0 +1,53 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+namespace seele::structs {
+
+// Lets consumers sleep on a futex until a producer has something for them.
+// A producer that finds nobody parked pays a fence and a load, no syscall
+// and no write to a shared line.
+class parker {
+public:
+    parker() = default;
+
+    parker(const parker&) = delete;
+    parker& operator=(const parker&) = delete;
+
+    // Producer side, after the work is published
+    void notify_one() {
+        // pairs with the fence in park(), one of the two sides sees the other
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (this->parked.load(std::memory_order_relaxed) != 0) {
+            this->epoch.fetch_add(1, std::memory_order_release);
+            this->epoch.notify_one();
+        }
+    }
+
+    // Wakes everyone, parked or about to park, e.g. on shutdown
+    void notify_all() {
+        this->epoch.fetch_add(1, std::memory_order_release);
+        this->epoch.notify_all();
+    }
+
+    // Consumer side. `ready` is the last look for work after registering as
+    // parked, a notify racing with it either shows up there or bumps the
+    // epoch so the wait returns right away.
+    template<typename predicate_t>
+    void park(predicate_t&& ready) {
+        auto seen = this->epoch.load(std::memory_order_acquire);
+        this->parked.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!ready()) {
+            this->epoch.wait(seen, std::memory_order_acquire);
+        }
+        this->parked.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    uint32_t parked_count() const { return this->parked.load(std::memory_order_relaxed); }
+
+private:
+    alignas(64) std::atomic<uint32_t> epoch{0};
+    alignas(64) std::atomic<uint32_t> parked{0};
+};
+
+}
@@ -0,0 +1,137 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+namespace seele::structs {
+
+// Grow-only lock-free list of per-thread records for the reclamation
+// managers. record_t needs a std::atomic<bool> `active`. A thread that exits
+// releases its record and the next new thread takes it over, so the list is
+// as long as the most threads that were ever using the manager at once.
+// Records are only freed with the registry, so walking the list needs no
+// protection of its own.
+template<typename record_t>
+class record_registry {
+private:
+    struct node_t : record_t {
+        node_t* next = nullptr;
+    };
+
+public:
+    class iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = record_t;
+        using difference_type = std::ptrdiff_t;
+        using pointer = record_t*;
+        using reference = record_t&;
+
+        iterator() = default;
+        explicit iterator(node_t* node) : node(node) {}
+
+        record_t& operator*() const { return *this->node; }
+        record_t* operator->() const { return this->node; }
+        iterator& operator++() {
+            this->node = this->node->next;
+            return *this;
+        }
+        iterator operator++(int) {
+            iterator old = *this;
+            ++*this;
+            return old;
+        }
+        bool operator==(const iterator&) const = default;
+
+    private:
+        node_t* node = nullptr;
+    };
+
+    record_registry() = default;
+
+    record_registry(const record_registry&) = delete;
+    record_registry& operator=(const record_registry&) = delete;
+
+    ~record_registry() {
+        node_t* node = this->head.load(std::memory_order_relaxed);
+        while (node) {
+            delete std::exchange(node, node->next);
+        }
+    }
+
+    // A released record if there is one, a new one otherwise. Never fails.
+    record_t* acquire() {
+        for (node_t* node = this->head.load(std::memory_order_acquire); node; node = node->next) {
+            bool expected = false;
+            if (!node->active.load(std::memory_order_relaxed)
+                && node->active.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                return node;
+            }
+        }
+        node_t* node = new node_t();
+        node->active.store(true, std::memory_order_relaxed);
+        node_t* old_head = this->head.load(std::memory_order_relaxed);
+        do {
+            node->next = old_head;
+        } while (!this->head.compare_exchange_weak(old_head, node, std::memory_order_release, std::memory_order_relaxed));
+        return node;
+    }
+
+    void release(record_t* record) {
+        record->active.store(false, std::memory_order_release);
+    }
+
+    // Every record ever handed out, active or not
+    iterator begin() const { return iterator{this->head.load(std::memory_order_acquire)}; }
+    iterator end() const { return iterator{}; }
+
+private:
+    std::atomic<node_t*> head{nullptr};
+};
+
+// Ids of the reclamation managers alive in the process. Thread-local record
+// maps are keyed by id, not address: a manager built where a destroyed one
+// was must not find the old one's records.
+class live_managers {
+public:
+    // Registers a new manager, ids are never reused and start at 1
+    static uint64_t add();
+    // From here on exiting threads leave the manager's records alone
+    static void remove(uint64_t id);
+    // Keeps every manager alive() sees from being removed while it is held
+    static std::unique_lock<std::mutex> lock();
+    static bool alive(uint64_t id);
+};
+
+// A thread's entries of the managers it used, by manager id. When the thread
+// exits, entry_t::release() runs for the managers still alive, under
+// live_managers::lock() so none of them goes away meanwhile.
+template<typename entry_t>
+struct tls_records : std::unordered_map<uint64_t, entry_t> {
+    tls_records() = default;
+
+    tls_records(const tls_records&) = delete;
+    tls_records& operator=(const tls_records&) = delete;
+
+    ~tls_records() {
+        auto lock = live_managers::lock();
+        for (auto& [id, entry] : *this) {
+            if (live_managers::alive(id)) {
+                entry.release();
+            }
+        }
+    }
+
+    // Drops the entries of managers destroyed since, their records went with them
+    void prune() {
+        auto lock = live_managers::lock();
+        std::erase_if(*this, [](const auto& entry) {
+            return !live_managers::alive(entry.first);
+        });
+    }
+};
+
+}
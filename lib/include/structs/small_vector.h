@@ -0,0 +1,133 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+namespace seele::structs {
+
+// Vector that keeps its first N elements inline and only goes to the heap
+// past that. clear() keeps whatever capacity it has, so a reused one stops
+// allocating once it has seen its largest size.
+template<typename T, size_t N>
+class small_vector {
+    static_assert(N > 0, "small_vector needs room for one element inline");
+public:
+    using value_type = T;
+    using iterator = T*;
+    using const_iterator = const T*;
+
+    small_vector() = default;
+
+    small_vector(const small_vector& other) {
+        this->copy_from(other);
+    }
+
+    small_vector(small_vector&& other) noexcept {
+        this->take(other);
+    }
+
+    small_vector& operator=(const small_vector& other) {
+        if (this != &other) {
+            this->clear();
+            this->copy_from(other);
+        }
+        return *this;
+    }
+
+    small_vector& operator=(small_vector&& other) noexcept {
+        if (this != &other) {
+            this->clear();
+            this->release();
+            this->take(other);
+        }
+        return *this;
+    }
+
+    ~small_vector() {
+        this->clear();
+        this->release();
+    }
+
+    template<typename... args_t>
+    T& emplace_back(args_t&&... args) {
+        if (this->count == this->cap) {
+            this->grow(this->cap * 2);
+        }
+        T* item = new (this->ptr + this->count) T(std::forward<args_t>(args)...);
+        this->count++;
+        return *item;
+    }
+
+    void reserve(size_t capacity) {
+        if (capacity > this->cap) {
+            this->grow(capacity);
+        }
+    }
+
+    void clear() {
+        std::destroy_n(this->ptr, this->count);
+        this->count = 0;
+    }
+
+    size_t size() const { return this->count; }
+    bool empty() const { return this->count == 0; }
+    size_t capacity() const { return this->cap; }
+
+    T& operator[](size_t i) { return this->ptr[i]; }
+    const T& operator[](size_t i) const { return this->ptr[i]; }
+
+    iterator begin() { return this->ptr; }
+    iterator end() { return this->ptr + this->count; }
+    const_iterator begin() const { return this->ptr; }
+    const_iterator end() const { return this->ptr + this->count; }
+
+private:
+    T* inline_data() { return std::launder(reinterpret_cast<T*>(this->storage)); }
+
+    bool is_inline() const { return this->cap == N; }
+
+    void grow(size_t capacity) {
+        T* bigger = static_cast<T*>(::operator new(capacity * sizeof(T), std::align_val_t{alignof(T)}));
+        std::uninitialized_move_n(this->ptr, this->count, bigger);
+        std::destroy_n(this->ptr, this->count);
+        this->release();
+        this->ptr = bigger;
+        this->cap = capacity;
+    }
+
+    // frees the heap block if there is one, the elements must be gone
+    void release() {
+        if (!this->is_inline()) {
+            ::operator delete(this->ptr, std::align_val_t{alignof(T)});
+            this->ptr = this->inline_data();
+            this->cap = N;
+        }
+    }
+
+    void copy_from(const small_vector& other) {
+        this->reserve(other.count);
+        std::uninitialized_copy_n(other.ptr, other.count, this->ptr);
+        this->count = other.count;
+    }
+
+    // Moves other's elements over, or its heap block, and leaves it empty.
+    // This one must be empty and inline.
+    void take(small_vector& other) {
+        if (other.is_inline()) {
+            std::uninitialized_move_n(other.ptr, other.count, this->ptr);
+            this->count = other.count;
+            other.clear();
+        } else {
+            this->ptr = std::exchange(other.ptr, other.inline_data());
+            this->cap = std::exchange(other.cap, N);
+            this->count = std::exchange(other.count, 0);
+        }
+    }
+
+    alignas(T) std::byte storage[N * sizeof(T)];
+    T* ptr = inline_data();
+    size_t count = 0;
+    size_t cap = N;
+};
+
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <optional>
+#include <utility>
+namespace seele::structs {
+
+// only for single producer single consumer use case
+// A chunk is freed by the consumer once it is drained and the producer has
+// moved on to the next one, so no hazard pointers are needed and the queue
+// can be created and destroyed freely (e.g. per connection).
+template<typename T, size_t MAX_NODES = 64>
+struct spsc_chunk{
+    struct node_t{
+        alignas(T) std::byte storage[sizeof(T)];
+        T& get() {
+            return *std::launder(reinterpret_cast<T*>(&storage));
+        }
+    };
+    node_t data[MAX_NODES];
+    alignas(64) size_t read_index;
+    alignas(64) std::atomic<size_t> write_index;
+    std::atomic<spsc_chunk*> next;
+    spsc_chunk() : read_index(0), write_index(0), next(nullptr) {}
+
+    ~spsc_chunk(){
+        for (size_t i = read_index; i < write_index.load(std::memory_order_relaxed); ++i) {
+            data[i].get().~T();
+        }
+    }
+};
+
+template <typename T, size_t N = 64>
+class spsc_queue {
+private:
+    using chunk_t = spsc_chunk<T, N>;
+
+public:
+    spsc_queue() : head_chunk(new chunk_t()), tail_chunk(head_chunk) {}
+    ~spsc_queue() {
+        chunk_t* current = head_chunk;
+        while (current) {
+            chunk_t* next = current->next.load(std::memory_order_relaxed);
+            delete current;
+            current = next;
+        }
+    }
+
+    spsc_queue(const spsc_queue&) = delete;
+    spsc_queue& operator=(const spsc_queue&) = delete;
+
+    void push_back(const T& item) { emplace_back(item); }
+
+    void push_back(T&& item) { emplace_back(std::move(item)); }
+
+    template<typename... args_t>
+    void emplace_back(args_t&&... args) {
+        size_t write_idx = tail_chunk->write_index.load(std::memory_order_relaxed);
+        if (write_idx == N) {
+            chunk_t* new_chunk = new chunk_t();
+            tail_chunk->next.store(new_chunk, std::memory_order_release);
+            tail_chunk = new_chunk;
+            write_idx = 0;
+        }
+        new (&tail_chunk->data[write_idx].storage) T(std::forward<args_t>(args)...);
+        tail_chunk->write_index.store(write_idx + 1, std::memory_order_release);
+    }
+
+    std::optional<T> pop_front() {
+        while (true) {
+            chunk_t* chunk = head_chunk;
+            if (chunk->read_index < chunk->write_index.load(std::memory_order_acquire)) {
+                auto& node = chunk->data[chunk->read_index];
+                T result = std::move(node.get());
+                node.get().~T();
+                chunk->read_index++;
+                return result;
+            }
+            if (chunk->read_index < N) {
+                return std::nullopt; // chunk is not full yet, nothing more to read
+            }
+            chunk_t* next = chunk->next.load(std::memory_order_acquire);
+            if (next == nullptr) {
+                return std::nullopt;
+            }
+            head_chunk = next;
+            delete chunk;
+        }
+    }
+
+private:
+    alignas(64) chunk_t* head_chunk;
+    alignas(64) chunk_t* tail_chunk;
+};
+
+}
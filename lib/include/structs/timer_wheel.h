@@ -0,0 +1,139 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+namespace seele::structs {
+
+// Intrusive node of a timer_wheel, embedded in whatever owns the timer.
+struct timer_node{
+    timer_node* prev = nullptr;
+    timer_node* next = nullptr;
+    uint64_t expires = 0;
+
+    bool linked() const { return this->next != nullptr; }
+
+    void unlink() {
+        this->prev->next = this->next;
+        this->next->prev = this->prev;
+        this->prev = this->next = nullptr;
+    }
+};
+
+// Hierarchical timer wheel counting in ticks, not thread safe.
+// Level L has 2^SLOT_BITS slots of 2^(SLOT_BITS*L) ticks each, timers are
+// cascaded down a level whenever the lower one wraps around, so add and
+// remove are O(1) and a tick only touches the timers that are due.
+// Timers further out than the wheel spans expire at its far end.
+template<size_t LEVELS = 4, size_t SLOT_BITS = 6>
+class timer_wheel {
+private:
+    static constexpr size_t SLOTS = size_t{1} << SLOT_BITS;
+    static constexpr uint64_t SLOT_MASK = SLOTS - 1;
+    static constexpr uint64_t MAX_DELTA = (uint64_t{1} << (SLOT_BITS * LEVELS)) - 1;
+
+public:
+    timer_wheel() {
+        for (auto& level : this->slots) {
+            for (auto& head : level) {
+                head.prev = head.next = &head;
+            }
+        }
+    }
+
+    timer_wheel(const timer_wheel&) = delete;
+    timer_wheel& operator=(const timer_wheel&) = delete;
+
+    uint64_t now() const { return this->current; }
+
+    bool empty() const { return this->count == 0; }
+
+    // Schedules `node` at tick `expires`, a due tick fires on the next advance
+    void add(timer_node* node, uint64_t expires) {
+        if (node->linked()) {
+            this->remove(node);
+        }
+        if (expires <= this->current) {
+            expires = this->current + 1;
+        } else if (expires - this->current > MAX_DELTA) {
+            expires = this->current + MAX_DELTA;
+        }
+        node->expires = expires;
+        this->link(node);
+        this->count++;
+    }
+
+    bool remove(timer_node* node) {
+        if (!node->linked()) {
+            return false;
+        }
+        node->unlink();
+        this->count--;
+        return true;
+    }
+
+    // Moves the wheel forward to tick `target`, handing every timer that
+    // came due to `on_expire` after unlinking it.
+    template<typename function_t>
+    void advance(uint64_t target, function_t&& on_expire) {
+        while (this->current < target) {
+            this->current++;
+            this->cascade(1);
+            this->expire(this->slots[0][this->current & SLOT_MASK], on_expire);
+        }
+    }
+
+    // Hands every timer to `on_expire`, due or not
+    template<typename function_t>
+    void expire_all(function_t&& on_expire) {
+        for (auto& level : this->slots) {
+            for (auto& head : level) {
+                this->expire(head, on_expire);
+            }
+        }
+    }
+
+private:
+    void link(timer_node* node) {
+        uint64_t delta = node->expires - this->current;
+        size_t level = 0;
+        while (level + 1 < LEVELS && delta >= (uint64_t{1} << (SLOT_BITS * (level + 1)))) {
+            level++;
+        }
+        auto& head = this->slots[level][(node->expires >> (SLOT_BITS * level)) & SLOT_MASK];
+        node->prev = head.prev;
+        node->next = &head;
+        head.prev->next = node;
+        head.prev = node;
+    }
+
+    // Re-links the timers of the slot at `level` the current tick just entered
+    void cascade(size_t level) {
+        while (level < LEVELS && ((this->current >> (SLOT_BITS * (level - 1))) & SLOT_MASK) == 0) {
+            auto& head = this->slots[level][(this->current >> (SLOT_BITS * level)) & SLOT_MASK];
+            timer_node* node = head.next;
+            head.prev = head.next = &head;
+            while (node != &head) {
+                timer_node* next = node->next;
+                this->link(node);
+                node = next;
+            }
+            level++;
+        }
+    }
+
+    template<typename function_t>
+    void expire(timer_node& head, function_t& on_expire) {
+        while (head.next != &head) {
+            timer_node* node = head.next;
+            node->unlink();
+            this->count--;
+            on_expire(node);
+        }
+    }
+
+    timer_node slots[LEVELS][SLOTS];
+    uint64_t current = 0;
+    size_t count = 0;
+};
+
+}
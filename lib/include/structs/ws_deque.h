@@ -0,0 +1,122 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <vector>
+namespace seele::structs {
+
+// Chase-Lev work stealing deque (with the C11 orderings of Lê et al.).
+// The owner pushes and pops at the bottom, any thread may steal from the top.
+// Arrays outgrown by the owner stay alive until the deque is destroyed, a
+// thief may still be reading from them.
+template<typename T>
+    requires std::is_trivially_copyable_v<T>
+class ws_deque {
+private:
+    struct array_t {
+        int64_t capacity;
+        std::unique_ptr<std::atomic<T>[]> buffer;
+
+        explicit array_t(int64_t capacity)
+            : capacity(capacity), buffer(new std::atomic<T>[capacity]) {}
+
+        T get(int64_t index) const {
+            return buffer[index & (capacity - 1)].load(std::memory_order_relaxed);
+        }
+        void put(int64_t index, T item) {
+            buffer[index & (capacity - 1)].store(item, std::memory_order_relaxed);
+        }
+    };
+
+public:
+    explicit ws_deque(int64_t capacity = 256) : top(0), bottom(0) {
+        this->arrays.push_back(std::make_unique<array_t>(capacity));
+        this->array.store(this->arrays.back().get(), std::memory_order_relaxed);
+    }
+
+    ws_deque(const ws_deque&) = delete;
+    ws_deque& operator=(const ws_deque&) = delete;
+
+    // owner only
+    void push(T item) {
+        int64_t b = this->bottom.load(std::memory_order_relaxed);
+        int64_t t = this->top.load(std::memory_order_acquire);
+        array_t* a = this->array.load(std::memory_order_relaxed);
+        if (b - t > a->capacity - 1) {
+            a = this->grow(a, t, b);
+        }
+        a->put(b, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        this->bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // owner only, takes the most recently pushed item
+    std::optional<T> pop() {
+        int64_t b = this->bottom.load(std::memory_order_relaxed) - 1;
+        array_t* a = this->array.load(std::memory_order_relaxed);
+        this->bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = this->top.load(std::memory_order_relaxed);
+        if (t > b) {
+            this->bottom.store(b + 1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+        T item = a->get(b);
+        if (t == b) {
+            // last item, race the thieves for it
+            bool won = this->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            this->bottom.store(b + 1, std::memory_order_relaxed);
+            if (!won) {
+                return std::nullopt;
+            }
+        }
+        return item;
+    }
+
+    // any thread, takes the oldest item. Also fails when it loses a race,
+    // so an empty result doesn't mean the deque is empty.
+    std::optional<T> steal() {
+        int64_t t = this->top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = this->bottom.load(std::memory_order_acquire);
+        if (t >= b) {
+            return std::nullopt;
+        }
+        array_t* a = this->array.load(std::memory_order_acquire);
+        T item = a->get(t);
+        if (!this->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return std::nullopt;
+        }
+        return item;
+    }
+
+    // a snapshot, only exact on the owner thread
+    int64_t size() const {
+        int64_t b = this->bottom.load(std::memory_order_relaxed);
+        int64_t t = this->top.load(std::memory_order_relaxed);
+        return b > t ? b - t : 0;
+    }
+
+private:
+    array_t* grow(array_t* old, int64_t t, int64_t b) {
+        auto bigger = std::make_unique<array_t>(old->capacity * 2);
+        for (int64_t i = t; i < b; ++i) {
+            bigger->put(i, old->get(i));
+        }
+        array_t* a = bigger.get();
+        this->arrays.push_back(std::move(bigger));
+        this->array.store(a, std::memory_order_release);
+        return a;
+    }
+
+    alignas(64) std::atomic<int64_t> top;
+    alignas(64) std::atomic<int64_t> bottom;
+    std::atomic<array_t*> array;
+    // every array ever used, touched by the owner only
+    std::vector<std::unique_ptr<array_t>> arrays;
+};
+
+}
@@ -1,27 +1,234 @@
 #include "coro/threadpool.h"
+#include <pthread.h>
+#include <sched.h>
+#include <algorithm>
+#include <charconv>
+#include <format>
+#include <fstream>
+#include <ranges>
+#include <string>
+#include <string_view>
+#include <utility>
 
 namespace seele::coro::thread {
 
+bool set_affinity(std::thread::native_handle_type handle, size_t cpu){
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(handle, sizeof(set), &set) == 0;
+}
+
+bool set_affinity(std::thread::native_handle_type handle, std::span<const size_t> cpus){
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto cpu : cpus) {
+        CPU_SET(cpu, &set);
+    }
+    return pthread_setaffinity_np(handle, sizeof(set), &set) == 0;
+}
+
+std::vector<size_t> available_cpus(){
+    std::vector<size_t> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (size_t cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    if (cpus.empty()) {
+        for (size_t cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+std::vector<size_t> node_cpus(size_t node){
+    std::vector<size_t> cpus;
+    // a cpulist looks like "0-3,8-11"
+    std::ifstream file{std::format("/sys/devices/system/node/node{}/cpulist", node)};
+    std::string list;
+    if (!std::getline(file, list)) {
+        return cpus;
+    }
+    auto available = available_cpus();
+    for (auto range : list | std::views::split(',')) {
+        std::string_view item{range.begin(), range.end()};
+        size_t first = 0, last = 0;
+        auto dash = item.find('-');
+        auto [ptr, ec] = std::from_chars(item.data(), item.data() + item.size(), first);
+        if (ec != std::errc{}) {
+            continue;
+        }
+        last = first;
+        if (dash != std::string_view::npos) {
+            std::from_chars(item.data() + dash + 1, item.data() + item.size(), last);
+        }
+        for (size_t cpu = first; cpu <= last; ++cpu) {
+            if (std::ranges::contains(available, cpu)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    return cpus;
+}
+
+void pool::configure(const pool_options& opts){
+    options = opts;
+}
+
 pool& pool::get_instance(){
-    static pool instance{4};
+    static pool instance{options};
     return instance;
 } 
 
 
-void pool::worker(std::stop_token st){
-    while(sem.acquire(), !st.stop_requested()){
-        
-        auto h = tasks.pop_front();
+namespace {
+    // consecutive LIFO slot runs before the worker looks at its deque again
+    constexpr size_t max_lifo_streak = 16;
+    // every that many tasks the injection queue is checked first, so it can't starve
+    constexpr size_t injector_interval = 61;
+    // tasks moved from the injection queue to the local deque at once
+    constexpr size_t injector_batch = 16;
+
+    uint64_t xorshift(uint64_t& state) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+}
+
+void pool::submit(std::coroutine_handle<> h){
+    if (auto* self = local_worker; self && self->owner == this) {
+        // the displaced one becomes stealable, everything else stays put
+        if (auto prev = std::exchange(self->lifo, h)) {
+            self->deque.push(prev);
+            this->notify();
+        }
+        return;
+    }
+    this->injector.emplace_back(h);
+    this->notify();
+}
+
+void pool::submit_bulk(std::span<const std::coroutine_handle<>> handles){
+    if (handles.empty()) {
+        return;
+    }
+    if (auto* self = local_worker; self && self->owner == this) {
+        for (auto h : handles) {
+            self->deque.push(h);
+        }
+    } else {
+        for (auto h : handles) {
+            this->injector.emplace_back(h);
+        }
+    }
+    this->notify();
+}
+
+void pool::notify(){
+    this->sleepers.notify_one();
+}
+
+std::coroutine_handle<> pool::steal(size_t index, uint64_t& rng){
+    size_t count = this->states.size();
+    size_t start = xorshift(rng) % count;
+    for (size_t i = 0; i < count; ++i) {
+        size_t victim = (start + i) % count;
+        if (victim == index) {
+            continue;
+        }
+        if (auto h = this->states[victim]->deque.steal(); h.has_value()) {
+            return h.value();
+        }
+    }
+    return nullptr;
+}
+
+std::coroutine_handle<> pool::find_task(worker_state& self, size_t index, uint64_t& rng){
+    if (auto h = self.deque.pop(); h.has_value()) {
+        return h.value();
+    }
+    if (auto h = this->injector.pop_front(); h.has_value()) {
+        for (size_t i = 1; i < injector_batch; ++i) {
+            auto more = this->injector.pop_front();
+            if (!more.has_value()) {
+                break;
+            }
+            self.deque.push(more.value());
+        }
+        if (self.deque.size() != 0) {
+            this->notify(); // let someone steal the rest of the batch
+        }
+        return h.value();
+    }
+    return this->steal(index, rng);
+}
+
+void pool::worker(std::stop_token st, size_t index){
+    auto& self = *this->states[index];
+    local_worker = &self;
+    uint64_t rng = 0x9e3779b97f4a7c15ull * (index + 1);
+    size_t lifo_streak = 0;
+    size_t tick = 0;
 
-        h->resume();
+    while (!st.stop_requested()) {
+        std::coroutine_handle<> h = nullptr;
+        if (self.lifo && lifo_streak < max_lifo_streak) {
+            h = std::exchange(self.lifo, nullptr);
+            lifo_streak++;
+        } else {
+            if (self.lifo) {
+                self.deque.push(std::exchange(self.lifo, nullptr));
+            }
+            lifo_streak = 0;
+            if (++tick % injector_interval == 0) {
+                if (auto injected = this->injector.pop_front(); injected.has_value()) {
+                    h = injected.value();
+                }
+            }
+            if (!h) {
+                h = this->find_task(self, index, rng);
+            }
+        }
+        if (h) {
+            h.resume();
+            continue;
+        }
+
+        // Park, after one last look for work once registered as a sleeper
+        this->sleepers.park([&] {
+            h = this->find_task(self, index, rng);
+            return h || st.stop_requested();
+        });
+        if (h) {
+            h.resume();
+        }
     }
+    local_worker = nullptr;
 }
-pool::pool(size_t worker_count) : sem{0} {
+
+pool::pool(const pool_options& opts) {
+    size_t worker_count = opts.workers != 0 ? opts.workers : available_cpus().size();
+    states.reserve(worker_count);
+    for(size_t i = 0; i < worker_count; ++i){
+        states.push_back(std::make_unique<worker_state>());
+        states.back()->owner = this;
+    }
     workers.reserve(worker_count);
     for(size_t i = 0; i < worker_count; ++i){
-        workers.emplace_back([this](std::stop_token st){
-            this->worker(st);
+        workers.emplace_back([this, i](std::stop_token st){
+            this->worker(st, i);
         });
+        if (!opts.cpus.empty()) {
+            set_affinity(workers.back().native_handle(), opts.cpus[i % opts.cpus.size()]);
+        }
     }
 }
 
@@ -29,7 +236,8 @@ pool::~pool() {
     for (auto& worker : workers) {
         worker.request_stop();
     }
-    sem.release(workers.size());
+    this->sleepers.notify_all();
+    workers.clear();
 }
 
 
@@ -0,0 +1,209 @@
+#include "simd.h"
+#include <bit>
+#include <cstddef>
+#include <string_view>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SEELE_SIMD_X86 1
+#endif
+
+namespace seele::simd {
+namespace {
+
+constexpr std::string_view CRLF = "\r\n";
+
+// The scalar kernels also finish what the vector ones leave over at the end,
+// starting at `from`
+size_t find_crlf_scalar(const char* data, size_t size, size_t from = 0) {
+    return std::string_view{data, size}.find(CRLF, from);
+}
+
+size_t span_scalar(const char* data, size_t size, const char_class& cls, size_t from = 0) {
+    size_t i = from;
+    while (i < size && cls.contains(data[i])) {
+        ++i;
+    }
+    return i;
+}
+
+#ifdef SEELE_SIMD_X86
+
+// A CR at i and a LF at i + 1: the block at i and the one a byte later are
+// compared, so every window needs one spare byte past its end.
+__attribute__((target("sse4.2")))
+size_t find_crlf_sse42(const char* data, size_t size) {
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    size_t i = 0;
+    for (; i + 16 < size; i += 16) {
+        __m128i at = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 1));
+        __m128i hit = _mm_and_si128(_mm_cmpeq_epi8(at, cr), _mm_cmpeq_epi8(next, lf));
+        if (auto mask = static_cast<uint32_t>(_mm_movemask_epi8(hit)); mask != 0) {
+            return i + std::countr_zero(mask);
+        }
+    }
+    return find_crlf_scalar(data, size, i);
+}
+
+// Looks up the low nibble of every byte in cls.nibbles and masks the result
+// with 1 << high nibble, a zero byte is a non-member. Bytes from 0x80 up
+// have a high nibble past 7, which maps to 0.
+__attribute__((target("sse4.2")))
+size_t span_sse42(const char* data, size_t size, const char_class& cls) {
+    const __m128i nibbles = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cls.nibbles.data()));
+    const __m128i high_bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i low_mask = _mm_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i lo = _mm_and_si128(v, low_mask);
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), low_mask);
+        __m128i hit = _mm_and_si128(_mm_shuffle_epi8(nibbles, lo), _mm_shuffle_epi8(high_bits, hi));
+        __m128i miss = _mm_cmpeq_epi8(hit, _mm_setzero_si128());
+        if (auto mask = static_cast<uint32_t>(_mm_movemask_epi8(miss)); mask != 0) {
+            return i + std::countr_zero(mask);
+        }
+    }
+    return span_scalar(data, size, cls, i);
+}
+
+__attribute__((target("avx2")))
+size_t find_crlf_avx2(const char* data, size_t size) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    size_t i = 0;
+    for (; i + 32 < size; i += 32) {
+        __m256i at = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 1));
+        __m256i hit = _mm256_and_si256(_mm256_cmpeq_epi8(at, cr), _mm256_cmpeq_epi8(next, lf));
+        if (auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(hit)); mask != 0) {
+            return i + std::countr_zero(mask);
+        }
+    }
+    // Half a block more with VEX encoded SSE. Calling the SSE kernel
+    // instead would stall on the switch from AVX to legacy SSE code.
+    if (i + 16 < size) {
+        __m128i at = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 1));
+        __m128i hit = _mm_and_si128(_mm_cmpeq_epi8(at, _mm256_castsi256_si128(cr)),
+                                    _mm_cmpeq_epi8(next, _mm256_castsi256_si128(lf)));
+        if (auto mask = static_cast<uint32_t>(_mm_movemask_epi8(hit)); mask != 0) {
+            return i + std::countr_zero(mask);
+        }
+        i += 16;
+    }
+    return find_crlf_scalar(data, size, i);
+}
+
+// The byte shuffle works within 128 bit lanes, so both tables are repeated
+// in each lane
+__attribute__((target("avx2")))
+size_t span_avx2(const char* data, size_t size, const char_class& cls) {
+    const __m256i nibbles = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(cls.nibbles.data())));
+    const __m256i high_bits = _mm256_broadcastsi128_si256(
+        _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0));
+    const __m256i low_mask = _mm256_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i lo = _mm256_and_si256(v, low_mask);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+        __m256i hit = _mm256_and_si256(_mm256_shuffle_epi8(nibbles, lo), _mm256_shuffle_epi8(high_bits, hi));
+        __m256i miss = _mm256_cmpeq_epi8(hit, _mm256_setzero_si256());
+        if (auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(miss)); mask != 0) {
+            return i + std::countr_zero(mask);
+        }
+    }
+    // half a block more, like find_crlf_avx2
+    if (i + 16 <= size) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i lo = _mm_and_si128(v, _mm256_castsi256_si128(low_mask));
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), _mm256_castsi256_si128(low_mask));
+        __m128i hit = _mm_and_si128(_mm_shuffle_epi8(_mm256_castsi256_si128(nibbles), lo),
+                                    _mm_shuffle_epi8(_mm256_castsi256_si128(high_bits), hi));
+        __m128i miss = _mm_cmpeq_epi8(hit, _mm_setzero_si128());
+        if (auto mask = static_cast<uint32_t>(_mm_movemask_epi8(miss)); mask != 0) {
+            return i + std::countr_zero(mask);
+        }
+        i += 16;
+    }
+    return span_scalar(data, size, cls, i);
+}
+
+#endif
+
+struct kernels_t {
+    size_t (*find_crlf)(const char*, size_t);
+    size_t (*span)(const char*, size_t, const char_class&);
+};
+
+constexpr kernels_t scalar_kernels{
+    [](const char* data, size_t size) { return find_crlf_scalar(data, size); },
+    [](const char* data, size_t size, const char_class& cls) { return span_scalar(data, size, cls); },
+};
+#ifdef SEELE_SIMD_X86
+constexpr kernels_t sse42_kernels{find_crlf_sse42, span_sse42};
+constexpr kernels_t avx2_kernels{find_crlf_avx2, span_avx2};
+#endif
+
+isa detect_isa() {
+#ifdef SEELE_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return isa::avx2;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        return isa::sse42;
+    }
+#endif
+    return isa::scalar;
+}
+
+const kernels_t* kernels_for(isa target) {
+    switch (target) {
+#ifdef SEELE_SIMD_X86
+        case isa::avx2: return &avx2_kernels;
+        case isa::sse42: return &sse42_kernels;
+#endif
+        default: return &scalar_kernels;
+    }
+}
+
+struct dispatch_t {
+    isa best;
+    isa current;
+    const kernels_t* kernels;
+};
+
+dispatch_t& dispatch() {
+    static dispatch_t d = [] {
+        isa best = detect_isa();
+        return dispatch_t{best, best, kernels_for(best)};
+    }();
+    return d;
+}
+
+}
+
+isa active_isa() {
+    return dispatch().current;
+}
+
+isa force_isa(isa target) {
+    auto& d = dispatch();
+    d.current = target < d.best ? target : d.best;
+    d.kernels = kernels_for(d.current);
+    return d.current;
+}
+
+size_t find_crlf(std::string_view str) {
+    return dispatch().kernels->find_crlf(str.data(), str.size());
+}
+
+size_t span(std::string_view str, const char_class& cls) {
+    return dispatch().kernels->span(str.data(), str.size(), cls);
+}
+
+}
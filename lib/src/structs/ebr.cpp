@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <exception>
+#include "structs/ebr.h"
+#include "log.h"
+namespace seele::structs {
+
+epoch_manager::tls_map_t::~tls_map_t() {
+    last_id = 0;
+    last_record = nullptr;
+}
+
+epoch_manager::epoch_manager(size_t scan_threshold)
+    : id(live_managers::add()), scan_threshold(scan_threshold) {}
+
+epoch_manager::~epoch_manager() {
+    live_managers::remove(this->id);
+    // nobody may use the manager anymore, so everything retired is unreachable
+    for (auto& record : this->records) {
+        if (record.epoch.load(std::memory_order_acquire) & 1) {
+            log::sync::error("Epoch manager destroyed while a thread is still pinned.");
+            std::terminate();
+        }
+        for (auto& [ptr, deleter, owner, epoch] : record.retired) {
+            deleter(ptr, owner);
+        }
+    }
+}
+
+epoch_manager::epoch_record_t& epoch_manager::lookup_record() {
+    static thread_local tls_map_t tls_map{};
+    auto it = tls_map.find(this->id);
+    if (it == tls_map.end()) {
+        tls_map.prune();
+        epoch_record_t* record = this->allocate_record();
+        record->retired.reserve(this->scan_threshold + 1);
+        it = tls_map.emplace(this->id, tls_entry_t{this, record}).first;
+    }
+    last_id = this->id;
+    last_record = it->second.record;
+    return *it->second.record;
+}
+
+epoch_manager::epoch_record_t* epoch_manager::allocate_record() {
+    return this->records.acquire();
+}
+
+void epoch_manager::release_record(epoch_record_t* record) {
+    record->held = 0;
+    record->epoch.store(0, std::memory_order_release);
+    this->collect(*record);
+    this->records.release(record);
+}
+
+void epoch_manager::pin(epoch_record_t& record) {
+    uint64_t epoch = this->global_epoch.load(std::memory_order_relaxed);
+    // the pin has to be visible before any shared pointer is read, and as an
+    // RMW it carries the release of the last unpin along to try_advance
+    record.epoch.exchange((epoch << 1) | 1, std::memory_order_seq_cst);
+}
+
+void epoch_manager::clear_all() {
+    auto& record = this->local_record();
+    if (record.held != 0) {
+        record.held = 0;
+        record.epoch.store(0, std::memory_order_release);
+    }
+}
+
+void epoch_manager::push_retired(void* ptr, auto (*deleter)(void*, void*) -> void, void* owner) {
+    auto& record = this->local_record();
+    record.retired.emplace_back(ptr, deleter, owner, this->global_epoch.load(std::memory_order_relaxed));
+    if (++record.retires_since_scan > this->scan_threshold) {
+        record.retires_since_scan = 0;
+        this->collect(record);
+    }
+    record.pending.store(record.retired.size(), std::memory_order_relaxed);
+}
+
+size_t epoch_manager::retired_count() const {
+    size_t count = 0;
+    for (auto& record : this->records) {
+        count += record.pending.load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+// Moves the global epoch one step on if every pinned thread has seen it
+bool epoch_manager::try_advance() {
+    uint64_t epoch = this->global_epoch.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    for (auto& record : this->records) {
+        uint64_t local = record.epoch.load(std::memory_order_acquire);
+        if ((local & 1) && (local >> 1) != epoch) {
+            return false;
+        }
+    }
+    return this->global_epoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_release, std::memory_order_relaxed);
+}
+
+void epoch_manager::collect(epoch_record_t& record) {
+    this->try_advance();
+    uint64_t epoch = this->global_epoch.load(std::memory_order_acquire);
+    std::erase_if(record.retired, [epoch](retired_ptr_t& rp) {
+        auto& [ptr, deleter, owner, retired_in] = rp;
+        if (retired_in + 2 > epoch) {
+            return false;
+        }
+        deleter(ptr, owner);
+        return true;
+    });
+    record.pending.store(record.retired.size(), std::memory_order_relaxed);
+}
+
+}
@@ -4,80 +4,79 @@
 #include "log.h"
 namespace seele::structs {
 
-hazard_manager::tls_map_t::~tls_map_t() {
-    for (auto& [manager, data] : *this) {
-        manager->scan_tls_retired();
-        if(data.retired_list.size() > 0) {
-            manager->collect_thread_unretired(data.retired_list);
-        }
-        manager->deallocate_record(data.record);
+void hazard_manager::tls_data_t::release() {
+    if (this->retired_list.size() > this->manager->scan_threshold) {
+        this->manager->scan_retired(this->retired_list, this->hazards);
     }
-
+    if (this->retired_list.size() > 0) {
+        this->manager->collect_thread_unretired(this->retired_list);
+    }
+    this->manager->deallocate_record(this->record);
 }
 
 
 
 hazard_manager::hazard_record_t* hazard_manager::allocate_record(){
-    for (auto& record : records) {
-        bool expected = false;
-        if (record.active.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
-            return &record;
-        }
-    }
-    return nullptr; 
+    return this->records.acquire();
 }
 
 
 inline void hazard_manager::deallocate_record(hazard_record_t* record){
-    record->active.store(false, std::memory_order_release);
+    for (auto& hp : record->hps) {
+        hp.store(nullptr, std::memory_order_relaxed);
+    }
+    record->pending.store(0, std::memory_order_relaxed);
+    this->records.release(record);
 }
 
 hazard_manager::tls_data_t& hazard_manager::local_tls() {
     static thread_local tls_map_t tls_map{};
-    auto it = tls_map.find(this);
+    auto it = tls_map.find(this->id);
     if (it != tls_map.end()) {
         return it->second;
     } else {
+        tls_map.prune();
         hazard_record_t* record = allocate_record();
-        // here we assume that allocate_record never returns nullptr
-        return tls_map.emplace(this, tls_data_t{record, {}}).first->second;
+        auto& data = tls_map.emplace(this->id, tls_data_t{this, record, {}, {}}).first->second;
+        data.retired_list.reserve(this->scan_threshold + 1);
+        return data;
     }
 }
-void hazard_manager::collect_thread_unretired(std::list<retired_ptr_t>& retireds){
+void hazard_manager::collect_thread_unretired(std::vector<retired_ptr_t>& retireds){
     std::lock_guard<std::mutex> lock(g_retired_mutex);
-    this->g_retired.splice(g_retired.end(), retireds);
-    if (g_retired.size() > hp::max_retired_count) {
-        this->scan_retired(g_retired);
+    this->g_retired.insert(g_retired.end(), retireds.begin(), retireds.end());
+    retireds.clear();
+    if (g_retired.size() > this->scan_threshold) {
+        this->scan_retired(g_retired, g_hazards);
     }
-    
-}
-
-void hazard_manager::scan_retired(std::list<retired_ptr_t>& retired_list){
-
-    auto hps = records
-        | std::views::filter([](hazard_record_t& rec) {
-            return rec.active.load(std::memory_order_acquire);
-        })
-        | std::views::transform([](hazard_record_t& rec) -> std::array<std::atomic<void*>, hp::max_hazard_count>& {
-            return rec.hps;
-        })
-        | std::views::join;
-    
-
+    this->g_pending.store(this->g_retired.size(), std::memory_order_relaxed);
 
-    retired_list.remove_if([&hps](retired_ptr_t& rp) {
+}
 
+void hazard_manager::scan_retired(std::vector<retired_ptr_t>& retired_list, std::vector<void*>& hazards){
+    // one pass over the active records, then a binary search per pointer
+    hazards.clear();
+    for (auto& record : this->records) {
+        if (!record.active.load(std::memory_order_acquire)) {
+            continue;
+        }
+        for (auto& hazard : record.hps) {
+            if (void* ptr = hazard.load(std::memory_order_acquire)) {
+                hazards.push_back(ptr);
+            }
+        }
+    }
+    std::ranges::sort(hazards);
 
-        auto& [ptr, deleter] = rp;
-        if (std::ranges::any_of(hps, [&ptr](std::atomic<void*>& hazard) {
-                return hazard.load(std::memory_order_acquire) == ptr;
-            })) {
+    std::erase_if(retired_list, [&hazards](retired_ptr_t& rp) {
+        auto& [ptr, deleter, owner] = rp;
+        if (std::ranges::binary_search(hazards, ptr)) {
             // If the retired pointer is still in use, we need to keep it
             return false;
         }
         // Otherwise, we can safely delete it
         if (deleter) {
-            deleter(ptr);
+            deleter(ptr, owner);
             return true; // Remove from the list
         }
         log::sync::error("retired pointer has no deleter.");
@@ -86,10 +85,25 @@ void hazard_manager::scan_retired(std::list<retired_ptr_t>& retired_list){
 }
 
 
+void hazard_manager::push_retired(void* ptr, auto (*deleter)(void*, void*) -> void, void* owner) {
+    auto& data = this->local_tls();
+    data.retired_list.emplace_back(ptr, deleter, owner);
+    this->scan_tls_retired();
+    data.record->pending.store(data.retired_list.size(), std::memory_order_relaxed);
+}
+
+size_t hazard_manager::retired_count() const {
+    size_t count = this->g_pending.load(std::memory_order_relaxed);
+    for (auto& record : this->records) {
+        count += record.pending.load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
 void hazard_manager::scan_tls_retired() {
-    auto& r = local_tls().retired_list;
-    if (r.size() > hp::max_retired_count) {
-        this->scan_retired(r);
+    auto& data = local_tls();
+    if (data.retired_list.size() > this->scan_threshold) {
+        this->scan_retired(data.retired_list, data.hazards);
     }
 }
 
@@ -114,10 +128,11 @@ hazard_manager::~hazard_manager() {
     //     this->deallocate_record(it->second.record);
     //     tls_map.erase(it);
     // }
+    live_managers::remove(this->id);
 
     std::lock_guard<std::mutex> lock(g_retired_mutex);
 
-    this->scan_retired(g_retired);
+    this->scan_retired(g_retired, g_hazards);
     if (g_retired.size() > 0) {
         log::sync::error("Hazard manager still has {} retired pointers after destruction.", g_retired.size());
         for (const auto& [index, record] : std::views::enumerate(this->records)) {
@@ -3,8 +3,9 @@
 #include "structs/mpsc_hp.h"
 #include "log.h"
 namespace seele::structs {
-    
+
 mpsc_hazard_manager::~mpsc_hazard_manager() {            
+    live_managers::remove(this->id);
     this->scan_retired();
     if (this->retired.size() > 0) {
         log::sync::error("Hazard manager still has {} retired pointers after destruction.", this->retired.size());
@@ -18,63 +19,63 @@ mpsc_hazard_manager::~mpsc_hazard_manager() {
     }
 }
 mpsc_hazard_manager::hazard_record_t* mpsc_hazard_manager::allocate_record(){
-    for (auto& record : records) {
-        bool expected = false;
-        if (record.active.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
-            return &record;
-        }
-    }
-    return nullptr; 
+    return this->records.acquire();
 }
 
 
 inline void mpsc_hazard_manager::deallocate_record(hazard_record_t* record){
-    record->active.store(false, std::memory_order_release);
+    for (auto& hp : record->hps) {
+        hp.store(nullptr, std::memory_order_relaxed);
+    }
+    this->records.release(record);
+}
+
+void mpsc_hazard_manager::tls_entry_t::release() {
+    this->manager->deallocate_record(this->record);
 }
 
 
 mpsc_hazard_manager::hazard_record_t* mpsc_hazard_manager::local_tls() {
     static thread_local tls_map_t tls_map{};
-    auto it = tls_map.find(this);
+    auto it = tls_map.find(this->id);
     if (it != tls_map.end()) {
-        return it->second;
+        return it->second.record;
     } else {
+        tls_map.prune();
         hazard_record_t* record = allocate_record();
-        // here we assume that allocate_record never returns nullptr
-        return tls_map.emplace(this, record).first->second;
+        return tls_map.emplace(this->id, tls_entry_t{this, record}).first->second.record;
     }
 }
 
 void mpsc_hazard_manager::scan_retired(){
+    // one pass over the active records, then a binary search per pointer
+    this->hazards.clear();
+    for (auto& record : this->records) {
+        if (!record.active.load(std::memory_order_acquire)) {
+            continue;
+        }
+        for (auto& hazard : record.hps) {
+            if (void* ptr = hazard.load(std::memory_order_acquire)) {
+                this->hazards.push_back(ptr);
+            }
+        }
+    }
+    std::ranges::sort(this->hazards);
 
-    auto hps = records
-        | std::views::filter([](hazard_record_t& rec) {
-            return rec.active.load(std::memory_order_acquire);
-        })
-        | std::views::transform([](hazard_record_t& rec) -> std::array<std::atomic<void*>, mpsc_hp::max_hazard_count>& {
-            return rec.hps;
-        })
-        | std::views::join;
-    
-
-
-    this->retired.remove_if([&hps](retired_ptr_t& rp) {
-
-
-        auto& [ptr, deleter] = rp;
-        if (std::ranges::any_of(hps, [&ptr](std::atomic<void*>& hazard) {
-                return hazard.load(std::memory_order_acquire) == ptr;
-            })) {
+    std::erase_if(this->retired, [this](retired_ptr_t& rp) {
+        auto& [ptr, deleter, owner] = rp;
+        if (std::ranges::binary_search(this->hazards, ptr)) {
             // If the retired pointer is still in use, we need to keep it
             return false;
         }
         // Otherwise, we can safely delete it
         if (deleter) {
-            deleter(ptr);
+            deleter(ptr, owner);
             return true; // Remove from the list
         }
         log::sync::error("retired pointer has no deleter.");
         std::terminate();
     });
+    this->pending.store(this->retired.size(), std::memory_order_relaxed);
 }
 }
\ No newline at end of file
@@ -0,0 +1,41 @@
+#include <unordered_set>
+#include "structs/record_registry.h"
+namespace seele::structs {
+namespace {
+
+struct live_set_t {
+    std::mutex mutex;
+    std::unordered_set<uint64_t> ids;
+    uint64_t next_id = 1;
+};
+
+live_set_t& live_set() {
+    static live_set_t live{};
+    return live;
+}
+
+}
+
+uint64_t live_managers::add() {
+    auto& live = live_set();
+    std::lock_guard<std::mutex> lock(live.mutex);
+    uint64_t id = live.next_id++;
+    live.ids.insert(id);
+    return id;
+}
+
+void live_managers::remove(uint64_t id) {
+    auto& live = live_set();
+    std::lock_guard<std::mutex> lock(live.mutex);
+    live.ids.erase(id);
+}
+
+std::unique_lock<std::mutex> live_managers::lock() {
+    return std::unique_lock<std::mutex>(live_set().mutex);
+}
+
+bool live_managers::alive(uint64_t id) {
+    return live_set().ids.contains(id);
+}
+
+}
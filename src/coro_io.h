@@ -1,5 +1,6 @@
 #pragma once
 #include <atomic>
+#include <chrono>
 #include <coroutine>
 #include <cstddef>
 #include <cstdint>
@@ -16,6 +17,7 @@
 #include <utility>
 #include "meta.h"
 #include "coro_io_ctx.h"
+#include "structs/spsc_queue.h"
 
 
 namespace coro_io {
@@ -78,10 +80,10 @@ namespace coro_io::awaiter {
 
 
 
+    // The completion state the ctx writes the result to and resumes, 
+    // user_data of the request points straight at it.
     template<typename derived>
-    struct base {
-        std::atomic<int32_t> io_ret;
-        std::coroutine_handle<> handle;
+    struct base : ctx::io_usr_data {
         bool await_ready() { return false; }
         std::coroutine_handle<> await_suspend(std::coroutine_handle<> handle) {
             this->handle = handle;
@@ -98,6 +100,13 @@ namespace coro_io::awaiter {
             this->io_ret = error::CTX_CLOSED;
             return this->handle;
         }
+        // Continues on the reaper thread if the ctx resumes selectively,
+        // for continuations that do little more than issue the next request
+        derived& inline_resume() {
+            this->prefer_inline = true;
+            return static_cast<derived&>(*this);
+        }
+
         int32_t await_resume() {
             io_ret = this->io_ret.load(std::memory_order_acquire);
             if (io_ret < 0) {
@@ -110,14 +119,7 @@ namespace coro_io::awaiter {
         int init(io_uring* ring) {
             auto* sqe = io_uring_get_sqe(ring);
             static_cast<derived*>(this)->setup(sqe);
-            sqe->user_data = std::bit_cast<std::uintptr_t>(
-                ctx::get_instance().new_usr_data(
-                    ctx::io_usr_data{
-                        this->handle,
-                        &this->io_ret
-                    }
-                )
-            );
+            sqe->user_data = ctx::make_usr_data(ctx::op_kind::io, static_cast<ctx::io_usr_data*>(this));
             return 1; // return the number of sqe written
         }
 
@@ -130,12 +132,16 @@ namespace coro_io::awaiter {
         void* buf;
         size_t len;
         off_t offset;
+        bool fixed_file;
 
-        read(int fd, void* buf, size_t len, off_t offset = 0)
-            : fd(fd), buf(buf), len(len), offset(offset) {}
+        read(int fd, void* buf, size_t len, off_t offset = 0, bool fixed_file = false)
+            : fd(fd), buf(buf), len(len), offset(offset), fixed_file(fixed_file) {}
 
         void setup(io_uring_sqe* sqe) {
             io_uring_prep_read(sqe, fd, buf, len, offset);
+            if (fixed_file) {
+                sqe->flags |= IOSQE_FIXED_FILE;
+            }
         }
     };
 
@@ -144,12 +150,16 @@ namespace coro_io::awaiter {
         const void* buf;
         unsigned int len;
         off_t offset;
+        bool fixed_file;
 
-        write(int fd, const void* buf, unsigned int len, off_t offset = 0)
-            : fd(fd), buf(buf), len(len), offset(offset) {}
+        write(int fd, const void* buf, unsigned int len, off_t offset = 0, bool fixed_file = false)
+            : fd(fd), buf(buf), len(len), offset(offset), fixed_file(fixed_file) {}
 
         void setup(io_uring_sqe* sqe) {
             io_uring_prep_write(sqe, fd, buf, len, offset);
+            if (fixed_file) {
+                sqe->flags |= IOSQE_FIXED_FILE;
+            }
         }
     };
 
@@ -158,12 +168,16 @@ namespace coro_io::awaiter {
         const iovec* iov;
         unsigned nr_iov;
         off_t offset;
+        bool fixed_file;
 
-        readv(int fd, const iovec* iov, unsigned nr_iov = 1, off_t offset = 0)
-            : fd(fd), iov(iov), nr_iov(nr_iov), offset(offset) {}
+        readv(int fd, const iovec* iov, unsigned nr_iov = 1, off_t offset = 0, bool fixed_file = false)
+            : fd(fd), iov(iov), nr_iov(nr_iov), offset(offset), fixed_file(fixed_file) {}
 
         void setup(io_uring_sqe* sqe) {
             io_uring_prep_readv(sqe, fd, iov, nr_iov, offset);
+            if (fixed_file) {
+                sqe->flags |= IOSQE_FIXED_FILE;
+            }
         }
     };
 
@@ -172,12 +186,16 @@ namespace coro_io::awaiter {
         const iovec* iov;
         unsigned nr_iov;
         off_t offset;
+        bool fixed_file = false;
         writev() = default;
-        writev(int fd, const iovec* iov, unsigned nr_iov, off_t offset = 0)
-            : fd(fd), iov(iov), nr_iov(nr_iov), offset(offset) {}
+        writev(int fd, const iovec* iov, unsigned nr_iov, off_t offset = 0, bool fixed_file = false)
+            : fd(fd), iov(iov), nr_iov(nr_iov), offset(offset), fixed_file(fixed_file) {}
 
         void setup(io_uring_sqe* sqe) {
             io_uring_prep_writev(sqe, fd, iov, nr_iov, offset);
+            if (fixed_file) {
+                sqe->flags |= IOSQE_FIXED_FILE;
+            }
         }
     };
 
@@ -193,61 +211,52 @@ namespace coro_io::awaiter {
         }
     };
 
-    struct read_direct : base<read_direct> {
-        int fd_index;
-        void* buf;
-        size_t len;
-        off_t offset;
-
-        read_direct(int fd_index, void* buf, size_t len, off_t offset = 0)
-            : fd_index(fd_index), buf(buf), len(len), offset(offset) {}
-
+    struct accept_direct : base<accept_direct> {
+        int fd;
+        sockaddr* addr;
+        socklen_t* addrlen;
+        int flags;
+        unsigned int file_index;
+        accept_direct(int fd, sockaddr* addr, socklen_t* addrlen, int flags = 0, unsigned int file_index = IORING_FILE_INDEX_ALLOC)
+            : fd(fd), addr(addr), addrlen(addrlen), flags(flags), file_index(file_index) {}
         void setup(io_uring_sqe* sqe) {
-            io_uring_prep_read(sqe, fd_index, buf, len, offset);
-            sqe->flags |= IOSQE_FIXED_FILE;
+            io_uring_prep_accept_direct(sqe, fd, addr, addrlen, flags, file_index);
         }
     };
 
-    struct write_direct : base<write_direct> {
-        int fd_index;
+    // Zero-copy sends, the pages are pinned until the kernel's notification
+    // and the awaiter resumes only after it, so the buffers may be released then.
+    struct send_zc : base<send_zc> {
+        int fd;
         const void* buf;
-        unsigned int len;
-        off_t offset;
-
-        write_direct(int fd_index, const void* buf, unsigned int len, off_t offset = 0)
-            : fd_index(fd_index), buf(buf), len(len), offset(offset) {}
-
-        void setup(io_uring_sqe* sqe) {
-            io_uring_prep_write(sqe, fd_index, buf, len, offset);
-            sqe->flags |= IOSQE_FIXED_FILE;
-        }
-    };
-
-    struct writev_direct : base<writev_direct> {
-        int fd_index;
-        const iovec* iov;
-        unsigned nr_iov;
-        off_t offset;
-
-        writev_direct(int fd_index, const iovec* iov, unsigned nr_iov, off_t offset = 0)
-            : fd_index(fd_index), iov(iov), nr_iov(nr_iov), offset(offset) {}
-
+        size_t len;
+        int flags;
+        bool fixed_file;
+        send_zc(int fd, const void* buf, size_t len, int flags = 0, bool fixed_file = false)
+            : fd(fd), buf(buf), len(len), flags(flags), fixed_file(fixed_file) {}
         void setup(io_uring_sqe* sqe) {
-            io_uring_prep_writev(sqe, fd_index, iov, nr_iov, offset);
-            sqe->flags |= IOSQE_FIXED_FILE;
+            io_uring_prep_send_zc(sqe, fd, buf, len, flags, 0);
+            if (fixed_file) {
+                sqe->flags |= IOSQE_FIXED_FILE;
+            }
         }
     };
 
-    struct accept_direct : base<accept_direct> {
+    struct sendmsg_zc : base<sendmsg_zc> {
         int fd;
-        sockaddr* addr;
-        socklen_t* addrlen;
+        msghdr msg;
         int flags;
-        unsigned int file_index;
-        accept_direct(int fd, sockaddr* addr, socklen_t* addrlen, int flags = 0, unsigned int file_index = IORING_FILE_INDEX_ALLOC)
-            : fd(fd), addr(addr), addrlen(addrlen), flags(flags), file_index(file_index) {}
+        bool fixed_file;
+        sendmsg_zc(int fd, const iovec* iov, size_t nr_iov, int flags = 0, bool fixed_file = false)
+            : fd(fd), msg{}, flags(flags), fixed_file(fixed_file) {
+            msg.msg_iov = const_cast<iovec*>(iov);
+            msg.msg_iovlen = nr_iov;
+        }
         void setup(io_uring_sqe* sqe) {
-            io_uring_prep_accept_direct(sqe, fd, addr, addrlen, flags, file_index);
+            io_uring_prep_sendmsg_zc(sqe, fd, &msg, flags);
+            if (fixed_file) {
+                sqe->flags |= IOSQE_FIXED_FILE;
+            }
         }
     };
 
@@ -261,14 +270,303 @@ namespace coro_io::awaiter {
 
     struct cancel_fd : base<cancel_fd> {
         int fd;
-        cancel_fd(int fd) : fd(fd) {}
+        unsigned int flags;
+        // IORING_ASYNC_CANCEL_FD_FIXED treats fd as a registered file index
+        cancel_fd(int fd, unsigned int flags = 0) : fd(fd), flags(flags) {}
         void setup(io_uring_sqe* sqe) {
-            io_uring_prep_cancel_fd(sqe, fd, 0);
+            io_uring_prep_cancel_fd(sqe, fd, flags);
         }
     };
 
 
 
+    struct multishot_result {
+        int32_t res;
+        uint32_t flags;
+        bool last;
+    };
+
+    // One SQE producing a stream of completions. Every cqe is queued for the
+    // owning coroutine, which pulls them with `co_await next()`. When the kernel
+    // ends the request (no IORING_CQE_F_MORE) it is re-armed if derived::rearm(res)
+    // agrees, otherwise the final result is delivered and the stream is finished.
+    // If derived::backoff(res) says the kernel ran out of something, the re-arm
+    // waits for the next tick instead of failing again right away.
+    // The owner must not be destroyed before it has received the final result.
+    template<typename derived>
+    struct multishot : ctx::multishot_usr_data {
+        enum class state_t : uint8_t { active, parked, rearming, stopped };
+
+        struct backoff_timer : ctx::timer {
+            multishot* self = nullptr;
+        };
+
+        seele::structs::spsc_queue<multishot_result> results;
+        std::atomic<std::coroutine_handle<>> waiter{nullptr};
+        std::atomic<bool> finished{false};
+        std::atomic<state_t> state{state_t::active};
+        backoff_timer parked_timer;
+        // see bind_deadline()
+        const ctx::timer* deadline = nullptr;
+        bool armed = false;
+        // results are picked up on the reaper thread if the ctx resumes selectively
+        bool prefer_inline = false;
+
+        multishot() : ctx::multishot_usr_data{&multishot::on_cqe} {
+            this->parked_timer.self = this;
+            this->parked_timer.on_expire = &multishot::on_backoff;
+        }
+
+        struct next_awaiter {
+            multishot* self;
+            std::optional<multishot_result> result;
+
+            bool await_ready() {
+                if (!self->armed) {
+                    self->armed = true;
+                    if (!self->arm()) {
+                        error::set_msg("Coro ctx closed.");
+                        result = multishot_result{error::CTX_CLOSED, 0, true};
+                        self->finished.store(true, std::memory_order_release);
+                        return true;
+                    }
+                }
+                result = self->results.pop_front();
+                return result.has_value();
+            }
+
+            bool await_suspend(std::coroutine_handle<> handle) {
+                self->waiter.store(handle, std::memory_order_release);
+                if (result = self->results.pop_front(); result.has_value()) {
+                    auto expected = handle;
+                    // If the producer already took the handle it will resume us, so we must suspend
+                    return !self->waiter.compare_exchange_strong(expected, nullptr, std::memory_order_acq_rel);
+                }
+                return true;
+            }
+
+            multishot_result await_resume() {
+                if (!result.has_value()) {
+                    result = self->results.pop_front();
+                }
+                if (result->last) {
+                    // wait until the producer has let go of us
+                    while (!self->finished.load(std::memory_order_acquire)) {}
+                }
+                if (result->res < 0 && result->res != error::CTX_CLOSED) {
+                    error::set_code(result->res);
+                    result->res = error::SYS;
+                }
+                return result.value();
+            }
+        };
+
+        next_awaiter next() { return {this, std::nullopt}; }
+
+        // Arms the request now instead of on the first next()
+        bool start() {
+            this->armed = true;
+            return this->arm();
+        }
+
+        // A parked re-arm is given up once `t` has expired, the cancel of
+        // the deadline had nothing in flight to hit.
+        void bind_deadline(const ctx::timer& t) {
+            this->deadline = &t;
+        }
+
+        // Keeps the request from being armed again. Call it before cancelling
+        // the request, a parked request ends right here.
+        void stop() {
+            auto s = this->state.load(std::memory_order_acquire);
+            while (true) {
+                if (s == state_t::stopped) {
+                    return;
+                }
+                if (s == state_t::rearming) {
+                    std::this_thread::yield();
+                    s = this->state.load(std::memory_order_acquire);
+                    continue;
+                }
+                if (this->state.compare_exchange_weak(s, state_t::stopped, std::memory_order_acq_rel)) {
+                    break;
+                }
+            }
+            // otherwise on_backoff() is about to run and finishes the stream
+            if (s == state_t::parked && this->parked_timer.owner->remove_timer(this->parked_timer)) {
+                this->finish({-ECANCELED, 0, true});
+            }
+        }
+
+        bool arm() {
+            return ctx::get_instance().submit(
+                this,
+                [](void* helper_ptr, io_uring* ring) {
+                    return static_cast<derived*>(static_cast<multishot*>(helper_ptr))->init(ring);
+                }
+            );
+        }
+
+        int init(io_uring* ring) {
+            auto* sqe = io_uring_get_sqe(ring);
+            static_cast<derived*>(this)->setup(sqe);
+            sqe->user_data = this->user_data();
+            return 1;
+        }
+
+        uint64_t user_data() const {
+            return ctx::make_usr_data(ctx::op_kind::multishot, static_cast<const ctx::multishot_usr_data*>(this));
+        }
+
+        // Runs on the reaper thread for every cqe of this request
+        static void on_cqe(ctx::multishot_usr_data* data, io_uring_cqe* cqe) {
+            auto* self = static_cast<multishot*>(data);
+            auto* impl = static_cast<derived*>(self);
+            multishot_result result{cqe->res, cqe->flags, !(cqe->flags & IORING_CQE_F_MORE)};
+            bool stopped = self->state.load(std::memory_order_acquire) == state_t::stopped;
+            if (result.last && !stopped && impl->rearm(result.res)) {
+                if (impl->backoff(result.res)) {
+                    if (self->park()) {
+                        return;
+                    }
+                    result.res = -ECANCELED;
+                } else if (self->arm()) {
+                    result.last = false;
+                } else if (result.res >= 0) {
+                    self->results.emplace_back(multishot_result{result.res, result.flags, false});
+                    result = {-ECANCELED, 0, true};
+                } else {
+                    result.res = -ECANCELED;
+                }
+            }
+            if (!result.last && result.res < 0) {
+                return; // transient error, the request is still armed
+            }
+            self->finish(result);
+        }
+
+        // Waits out a tick on the timer wheel before arming again
+        bool park() {
+            auto& c = ctx::get_instance();
+            if (!c.add_timer(this->parked_timer, std::chrono::nanoseconds{1})) {
+                return false;
+            }
+            auto expected = state_t::active;
+            if (this->state.compare_exchange_strong(expected, state_t::parked, std::memory_order_acq_rel)) {
+                return true;
+            }
+            // stopped in the meantime
+            return !c.remove_timer(this->parked_timer);
+        }
+
+        // Runs on the ring thread once the backoff ran out
+        static void on_backoff(ctx::timer* t) {
+            auto* self = static_cast<backoff_timer*>(t)->self;
+            auto expected = state_t::parked;
+            if (!self->state.compare_exchange_strong(expected, state_t::rearming, std::memory_order_acq_rel)) {
+                // stop() came too late to take the timer out
+                self->finish({-ECANCELED, 0, true});
+                return;
+            }
+            bool given_up = self->deadline && self->deadline->expired.load(std::memory_order_acquire);
+            bool rearmed = !given_up && self->arm();
+            self->state.store(state_t::active, std::memory_order_release);
+            if (!rearmed) {
+                self->finish({-ECANCELED, 0, true});
+            }
+        }
+
+        void finish(const multishot_result& result) {
+            this->results.emplace_back(result);
+
+            auto handle = this->waiter.exchange(nullptr, std::memory_order_acq_rel);
+            bool prefer_inline = this->prefer_inline;
+            if (result.last) {
+                // last access to this, the owner may be gone once it sees this
+                this->finished.store(true, std::memory_order_release);
+            }
+            if (handle) {
+                ctx::get_instance().resume(handle, prefer_inline);
+            }
+        }
+
+        bool rearm(int32_t) { return false; }
+        bool backoff(int32_t) { return false; }
+        void setup(io_uring_sqe* sqe) { std::terminate();}
+    };
+
+    // Yields every connection accepted on `fd`; a negative result ends the stream.
+    // With `direct` the connections are installed into free slots of the
+    // registered file table and the results are slot indices.
+    struct multishot_accept : multishot<multishot_accept> {
+        int fd;
+        int flags;
+        bool direct;
+        explicit multishot_accept(int fd, int flags = 0, bool direct = false) : fd(fd), flags(flags), direct(direct) {}
+
+        void setup(io_uring_sqe* sqe) {
+            if (direct) {
+                io_uring_prep_multishot_accept_direct(sqe, fd, nullptr, nullptr, flags);
+            } else {
+                io_uring_prep_multishot_accept(sqe, fd, nullptr, nullptr, flags);
+            }
+        }
+
+        // The kernel drops multishot accept on any error, keep accepting unless
+        // the listener itself is gone.
+        bool rearm(int32_t res) {
+            switch (res) {
+                case -EINVAL:
+                case -EBADF:
+                case -ENOTSOCK:
+                case -ECANCELED:
+                    return false;
+                default:
+                    return true;
+            }
+        }
+
+        // out of fds or free slots, those come back as connections close
+        bool backoff(int32_t res) {
+            return res == -ENFILE || res == -EMFILE;
+        }
+    };
+
+    // Yields every chunk received on `fd` in a buffer of provided buffer group
+    // `group`, picked by the kernel only once data arrives. The buffer id is
+    // `flags >> IORING_CQE_BUFFER_SHIFT` and must go back through ctx::recycle_buf.
+    // 0 ends the stream on EOF.
+    struct multishot_recv : multishot<multishot_recv> {
+        int fd;
+        uint16_t group;
+        bool fixed_file;
+        multishot_recv(int fd, uint16_t group, bool fixed_file = false) : fd(fd), group(group), fixed_file(fixed_file) {}
+
+        void setup(io_uring_sqe* sqe) {
+            io_uring_prep_recv_multishot(sqe, fd, nullptr, 0, 0);
+            sqe->flags |= IOSQE_BUFFER_SELECT;
+            if (fixed_file) {
+                sqe->flags |= IOSQE_FIXED_FILE;
+            }
+            sqe->buf_group = group;
+        }
+
+        // The kernel also stops a multishot recv when the group runs dry
+        // or it decides to flush a full buffer, both are worth retrying.
+        bool rearm(int32_t res) {
+            return res > 0 || res == -ENOBUFS;
+        }
+
+        // an empty group only refills as connections hand buffers back
+        bool backoff(int32_t res) {
+            return res == -ENOBUFS;
+        }
+
+        static uint16_t buf_id(uint32_t flags) {
+            return static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+        }
+    };
+
     struct kernel_ts : __kernel_timespec {
         template<typename duration_t>
             requires seele::meta::is_specialization_of_v<std::decay_t<duration_t>, std::chrono::duration>
@@ -306,25 +604,14 @@ namespace coro_io::awaiter {
             auto* timeout_sqe = io_uring_get_sqe(ring);
             // Need to handle validation of sqe, but we assume the it's valid
             this->awaiter.setup(sqe);
-            auto io_data = ctx::get_instance().new_usr_data(
-                std::in_place_type<ctx::io_usr_data>,
-                this->awaiter.handle,
-                &this->awaiter.io_ret
-            );  
-
-            sqe->user_data = std::bit_cast<std::uintptr_t>(io_data);
+            auto* io_data = static_cast<ctx::io_usr_data*>(&this->awaiter);
+            sqe->user_data = ctx::make_usr_data(ctx::op_kind::io, io_data);
 
             sqe->flags |= IOSQE_IO_LINK;
 
             io_uring_prep_link_timeout(timeout_sqe, &this->ts, 0);
 
-            timeout_sqe->user_data = std::bit_cast<std::uintptr_t>(
-                ctx::get_instance().new_usr_data(
-                    ctx::timeout_usr_data{
-                        io_data
-                    }
-                )
-            );
+            timeout_sqe->user_data = ctx::make_usr_data(ctx::op_kind::timeout, io_data);
             return 2;
         }
 
@@ -343,6 +630,118 @@ namespace coro_io::awaiter {
     };
 
 
+    // Resumes the coroutine once `duration` has passed, rounded up to the
+    // tick of the ctx's timer wheel.
+    struct sleep_for {
+        ctx::timer timer;
+        std::chrono::nanoseconds duration;
+        int32_t ret = 0;
+
+        template<typename duration_t>
+        sleep_for(duration_t&& duration) : duration(std::forward<duration_t>(duration)) {}
+
+        bool await_ready() { return this->duration.count() <= 0; }
+        bool await_suspend(std::coroutine_handle<> handle) {
+            this->timer.handle = handle;
+            if (ctx::get_instance().add_timer(this->timer, this->duration)) {
+                return true;
+            }
+            error::set_msg("Coro ctx closed.");
+            this->ret = error::CTX_CLOSED;
+            return false;
+        }
+        int32_t await_resume() { return this->ret; }
+    };
+
+    // Cancels every request on `fd` when it expires, without a timeout SQE of
+    // its own. arm() (re)starts it for the next read or write, clear() stops it.
+    // Nothing may be in flight when it runs out, so check expired() before
+    // issuing the next request.
+    struct deadline {
+        ctx::timer timer;
+
+        // Suspends until the cancel of an expiry has completed. Before that
+        // it may still hit a request issued on the fd, or another connection
+        // that got the fd number once it was closed.
+        struct settle_awaiter {
+            ctx::timer& timer;
+
+            bool await_ready() {
+                return this->timer.cancel_state.load(std::memory_order_acquire) == 0;
+            }
+            bool await_suspend(std::coroutine_handle<> handle) {
+                auto expected = ctx::timer::cancel_pending;
+                // fails if the cancel completed in the meantime
+                return this->timer.cancel_state.compare_exchange_strong(
+                    expected, std::bit_cast<std::uintptr_t>(handle.address()), std::memory_order_acq_rel
+                );
+            }
+            void await_resume() {}
+        };
+
+        // Arms it again once a cancel of the last expiry has completed.
+        // Yields false without arming if it expired since it was last armed.
+        struct rearm_awaiter : settle_awaiter {
+            std::chrono::nanoseconds duration;
+
+            bool await_ready() {
+                if (this->timer.owner) {
+                    this->timer.owner->remove_timer(this->timer);
+                }
+                return settle_awaiter::await_ready();
+            }
+            bool await_resume() {
+                if (this->timer.expired.load(std::memory_order_acquire)) {
+                    return false;
+                }
+                return ctx::get_instance().add_timer(this->timer, this->duration);
+            }
+        };
+
+        deadline(int fd, bool fixed_file = false) {
+            this->timer.fd = fd;
+            this->timer.fixed_file = fixed_file;
+        }
+        ~deadline() {
+            this->clear();
+            if (this->timer.cancel_state.load(std::memory_order_acquire) != 0) {
+                std::println("Deadline destroyed before its cancel completed, co_await settle() first");
+                std::terminate();
+            }
+        }
+
+        deadline(const deadline&) = delete;
+        deadline& operator=(const deadline&) = delete;
+
+        template<typename duration_t>
+        bool arm(duration_t&& duration) {
+            return ctx::get_instance().add_timer(this->timer, std::forward<duration_t>(duration));
+        }
+
+        template<typename duration_t>
+        rearm_awaiter rearm(duration_t&& duration) {
+            return {{this->timer}, std::forward<duration_t>(duration)};
+        }
+
+        // Returns false if it wasn't armed, e.g. because it already expired.
+        // A cancel of the expiry may still be on its way, see settle().
+        bool clear() {
+            if (!this->timer.owner) {
+                return false;
+            }
+            return this->timer.owner->remove_timer(this->timer);
+        }
+
+        settle_awaiter settle() {
+            return {this->timer};
+        }
+
+        // Ran out since it was last armed
+        bool expired() const {
+            return this->timer.expired.load(std::memory_order_acquire);
+        }
+    };
+
     template<typename function_t, typename... args_t>
         requires std::is_invocable_v<function_t, io_uring_sqe*, args_t...>
     struct any : base<any<function_t, args_t...>> {
@@ -14,7 +14,6 @@
 #include <optional>
 #include <print>
 #include <thread>
-#include <variant>
 #include <vector>
 using namespace seele;
 using std::chrono::operator""ms;
@@ -23,87 +22,190 @@ using std::chrono::operator""ns;
 
 namespace coro_io {
 
+ctx::ctx(const ctx_options& opts) 
+    : max_entries{opts.entries}, 
+    direct_submit{opts.direct_submit}, 
+    ring_disabled{false},
+    pending_req_count{0},
+    mode{opts.direct_submit ? resume_mode::run_to_completion : opts.resume},
+    inline_budget{opts.inline_budget},
+    busy_poll{opts.busy_poll},
+    tick_interval{opts.tick}, tick_epoch{std::chrono::steady_clock::now()} {
+
+    this->tick.on_cqe = &ctx::on_tick;
+    this->tick.self = this;
+    auto tick_sec = std::chrono::duration_cast<std::chrono::seconds>(opts.tick);
+    this->tick.ts.tv_sec = tick_sec.count();
+    this->tick.ts.tv_nsec = (opts.tick - tick_sec).count();
+
+    if (this->direct_submit) {
+        // Single issuer lets the kernel skip submission locking, deferred task
+        // work runs completions only when the owner waits for them.
+        // Kernels older than 6.1 reject these flags, fall back to a plain ring.
+        uint32_t flags = opts.flags | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_R_DISABLED;
+        if (io_uring_queue_init(opts.entries, &ring, flags) == 0) {
+            this->ring_disabled = true;
+            this->defer_taskrun = true;
+            return;
+        }
+        log::sync::warn("io_uring single issuer setup is not supported, using a plain ring");
+    }
+
+    if(io_uring_queue_init(opts.entries, &ring, opts.flags) < 0) {
+        std::println("Failed to initialize io_uring");
+        std::terminate();
+    }
+    if (!this->direct_submit) {
+        this->worker_thread = std::jthread([&] (std::stop_token st) { worker(st); }, stop_src.get_token());
+        this->is_worker_running.store(true, std::memory_order_release);
+    }
+}
+
+void ctx::bind_local() {
+    local_instance = this;
+    this->issuer = std::this_thread::get_id();
+    if (this->ring_disabled) {
+        if (auto ret = io_uring_enable_rings(&ring); ret < 0) {
+            std::println("Failed to enable io_uring: {}", strerror(-ret));
+            std::terminate();
+        }
+        this->ring_disabled = false;
+    }
+}
 
 
 void ctx::worker(std::stop_token st){
+    // keeps get_instance() pointing at this ctx on the submitter thread
+    this->bind_local();
+    std::stop_callback wake_on_stop(st, [this] {
+        this->unprocessed_requests.wake_all();
+    });
+
+    auto flush = [this](size_t pending_req_count) {
+        this->pending_req_count.fetch_add(pending_req_count, std::memory_order_acq_rel);
+        auto submit_ret = io_uring_submit(&ring);
+        if (submit_ret < 0) {
+            log::async::error("io_uring_submit failed: {}", strerror(-submit_ret));
+        } else {
+            log::async::debug("Submitted {} requests to io_uring", submit_ret);
+        }
+    };
 
-    size_t submit_count = 0;
-    size_t pending_req_count = 0;
     while (!st.stop_requested()) {
+        // Writes SQEs for everything queued and submits them with one syscall,
+        // spinning briefly and then sleeping while there is nothing
+        size_t pending_req_count = 0;
+        this->unprocessed_requests.wait_drain([&](request&& req) {
+            // keep room for a linked pair, flushing early if the SQ is full
+            if (io_uring_sq_space_left(&ring) < 2) {
+                flush(std::exchange(pending_req_count, 0));
+            }
+            req.ring_handle(req.helper_ptr, &ring);
+            pending_req_count++;
+        });
+        if (pending_req_count) {
+            flush(pending_req_count);
+        }
+    }
+    this->is_worker_running.store(false, std::memory_order_release);
+}
 
-        if (unp_sem.try_acquire_for(25ms)) {
-            auto req = unprocessed_requests.pop_front();
-            auto& [helper_ptr, ring_handle] = req.value();
-            submit_count += ring_handle(helper_ptr, &ring);
 
-            pending_req_count++;
-            
-            if (submit_count >= submit_threshold) {
-                auto submit_ret = io_uring_submit(&ring);
-                if (submit_ret < 0) {
-                    log::async::error("io_uring_submit failed: {}", strerror(-submit_ret));
-                } else {
-                    log::async::debug("Submitted {} requests to io_uring", submit_ret);
-                    submit_count = 0;
+void ctx::handle_cqes(io_uring_cqe*) {
+    this->inline_left = this->inline_budget;
+    std::array<io_uring_cqe*, cqe_batch> cqes;
+    size_t total = 0;
+    unsigned count = 0;
+    do {
+        count = io_uring_peek_batch_cqe(&ring, cqes.data(), cqes.size());
+        for (unsigned i = 0; i < count; ++i) {
+            this->handle_cqe(cqes[i]);
+        }
+        io_uring_cq_advance(&ring, count);
+        total += count;
+    } while (count == cqes.size());
+    // one push and at most one wakeup for everything this harvest completed
+    this->flush_dispatch();
+    log::async::debug("Processed {} completed requests", total);      
+}
+
+void ctx::handle_cqe(io_uring_cqe* cqe) {
+    auto* data = std::bit_cast<void*>(static_cast<std::uintptr_t>(cqe->user_data & ~op_kind_mask));
+    switch (static_cast<op_kind>(cqe->user_data & op_kind_mask)) {
+        case op_kind::io: {
+            auto* io_data = static_cast<io_usr_data*>(data);
+            // Zero-copy sends post the result with F_MORE first and a F_NOTIF cqe
+            // once the kernel let go of the buffers, resume only after the latter.
+            if (!(cqe->flags & IORING_CQE_F_NOTIF)) {
+                io_data->io_ret.store(cqe->res, std::memory_order_release); // Copy the cqe result to the awaiter
+                if (cqe->flags & IORING_CQE_F_MORE) {
+                    break;
                 }
             }
-        } else {
-            if (submit_count) {
-                this->pending_req_count.fetch_add(pending_req_count, std::memory_order_acq_rel);
-                auto submit_ret = io_uring_submit(&ring);
-                if (submit_ret < 0) {
-                    log::async::error("io_uring_submit failed: {}", strerror(-submit_ret));
-                } else {
-                    log::async::debug("Submitted {} requests to io_uring", submit_ret);
-                    submit_count = 0;
-                    pending_req_count = 0;
-                }
+            this->pending_req_count.fetch_sub(1, std::memory_order_release);
+            this->resume(io_data->handle, io_data->prefer_inline);
+            break;
+        }
+        case op_kind::timeout:
+            switch (cqe->res) {
+                case -ETIME:
+                case -ECANCELED:
+                case -ENOENT:
+                    break; // Timeout or canceled or no entry, skip this cqe
+                default:
+                    std::println("Timeout req is broken, handle {}, {}", 
+                        math::tohex(static_cast<io_usr_data*>(data)->handle), cqe->res);
+                    std::terminate();
             }
+            break;
+        case op_kind::multishot: {
+            // The request stays armed, and its awaiter alive, until a cqe without F_MORE
+            if (!(cqe->flags & IORING_CQE_F_MORE)) {
+                this->pending_req_count.fetch_sub(1, std::memory_order_release);
+            }
+            auto* multishot_data = static_cast<multishot_usr_data*>(data);
+            multishot_data->on_cqe(multishot_data, cqe);
+            break;
         }
+        case op_kind::detached:
+            this->pending_req_count.fetch_sub(1, std::memory_order_release);
+            break;
     }
-    this->pending_req_count.fetch_add(pending_req_count, std::memory_order_acq_rel);
-    this->is_worker_running.store(false, std::memory_order_release);
 }
 
 
-void ctx::handle_cqes(io_uring_cqe* cqe) {
-    int head, count = 0;
-    size_t processed_req = 0;
-    io_uring_for_each_cqe(&ring, head, cqe) {
-        count++;
-        auto* data = std::bit_cast<usr_data*>(cqe->user_data);
-        std::visit(
-            [&]<typename T>(T& usr_data) {
-                if constexpr (std::is_same_v<T, io_usr_data>) {
-                    usr_data.io_ret->store(cqe->res, std::memory_order_release); // Copy the cqe result to the user data
-                    coro::thread::dispatch(usr_data.handle);
-                    this->pending_req_count.fetch_sub(1, std::memory_order_release);
-                } else if constexpr (std::is_same_v<T, timeout_usr_data>) {
-                    switch (cqe->res) {
-                        case -ETIME:
-                        case -ECANCELED:
-                        case -ENOENT:
-                            break; // Timeout or canceled or no entry, skip this cqe
-                        default:{
-                            auto* io_data = std::get_if<io_usr_data>(usr_data.io_data);
-                            std::println("Timeout req is broken, handle {}, {}", math::tohex(io_data->handle), cqe->res);
-                            std::terminate();
-                        }
-                    }
-                } else {
-                    log::async::error("Unknown user data type in cqe");
-                }
-            },
-            *data
-        );
-        this->usr_data_pool.deallocate(data); // Clean up the user data
+
+void ctx::run_deferred() {
+    // the ones deferred again while these run wait for the next round
+    std::swap(this->deferred, this->running_deferred);
+    for (auto handle : this->running_deferred) {
+        handle.resume();
     }
-    io_uring_cq_advance(&ring, count);
-    this->pending_req_count.fetch_sub(processed_req, std::memory_order_acq_rel);
-    log::async::debug("Processed {} completed requests", count);      
+    this->running_deferred.clear();
 }
 
+void ctx::flush_dispatch() {
+    if (!this->dispatch_batch.empty()) {
+        seele::coro::thread::dispatch_bulk(this->dispatch_batch);
+        this->dispatch_batch.clear();
+    }
+}
 
+bool ctx::poll_cq() {
+    if (this->busy_poll.count() == 0) {
+        return false;
+    }
+    auto until = std::chrono::steady_clock::now() + this->busy_poll;
+    do {
+        if (this->defer_taskrun) {
+            io_uring_get_events(&ring);
+        }
+        if (io_uring_cq_ready(&ring) != 0) {
+            return true;
+        }
+    } while (std::chrono::steady_clock::now() < until);
+    return false;
+}
 
 void ctx::start_listen(std::stop_token st){
     sigset_t sigmask;
@@ -112,17 +214,47 @@ void ctx::start_listen(std::stop_token st){
 
     while (!st.stop_requested()) {
         io_uring_cqe* cqe;
-        int ret = io_uring_wait_cqes(&ring, &cqe, 1, nullptr, &sigmask); 
+        // Coroutines over the inline budget are waiting for their turn, only peek then
+        int ret = this->deferred.empty() && !this->poll_cq()
+            ? io_uring_wait_cqes(&ring, &cqe, 1, nullptr, &sigmask)
+            : io_uring_peek_cqe(&ring, &cqe);
 
         if (ret == -EINTR){
             log::async::debug("io_uring_wait_cqes interrupted by signal, checking for stop request");
             continue; // Interrupted by signal, continue waiting
+        } else if (ret == -EAGAIN) {
+            // nothing completed in the meantime
         } else if (ret < 0) {
             log::sync::error("io_uring_wait_cqes failed: {}", strerror(-ret));
             break;
         } else {
             this->handle_cqes(cqe);
         }
+        this->run_deferred();
+    }
+}
+
+void ctx::start_direct(std::stop_token st){
+    while (!st.stop_requested()) {
+        // Flushes every SQE written since the last tick and waits for at least one
+        // completion, unless coroutines over the inline budget are waiting for their
+        // turn or something completed while spinning
+        bool ready = !this->deferred.empty();
+        if (!ready && this->busy_poll.count() != 0) {
+            io_uring_submit(&ring);
+            ready = this->poll_cq();
+        }
+        int ret = io_uring_submit_and_wait(&ring, ready ? 0 : 1);
+
+        if (ret == -EINTR){
+            continue;
+        } else if (ret < 0) {
+            log::sync::error("io_uring_submit_and_wait failed: {}", strerror(-ret));
+            break;
+        } else {
+            this->handle_cqes(nullptr);
+        }
+        this->run_deferred();
     }
 }
 
@@ -134,13 +266,31 @@ void ctx::clean_up() {
     // Clean up remaining requests
 
     size_t pending_req_count = 0;
-    while (unp_sem.try_acquire_for(5ms)) {
-        auto req = unprocessed_requests.pop_front();
-        auto& [helper_ptr, ring_handle] = req.value();
-        ring_handle(helper_ptr, &ring);
-        pending_req_count++;
+    if (!this->direct_submit) {
+        this->unprocessed_requests.drain([&](request&& req) {
+            if (io_uring_sq_space_left(&ring) < 2) {
+                io_uring_submit(&ring);
+            }
+            req.ring_handle(req.helper_ptr, &ring);
+            pending_req_count++;
+        });
     }
     this->pending_req_count.fetch_add(pending_req_count, std::memory_order_acq_rel);
+
+    // Nothing new gets submitted from here on, so expire every timer now and
+    // let the deadlines cancel their connections instead of waiting for them.
+    this->expire_timers(true);
+    bool ticking = false;
+    {
+        std::lock_guard lock(this->timer_mutex);
+        ticking = this->tick.running;
+    }
+    if (ticking) {
+        auto* sqe = io_uring_get_sqe(&ring);
+        io_uring_prep_timeout_remove(sqe, make_usr_data(op_kind::multishot, &this->tick), 0);
+        sqe->user_data = make_usr_data(op_kind::detached);
+        this->pending_req_count.fetch_add(1, std::memory_order_acq_rel);
+    }
     auto submit_ret = io_uring_submit(&ring);
     if (submit_ret < 0) {
         log::async::error("io_uring_submit failed: {}", strerror(-submit_ret));
@@ -166,11 +316,224 @@ void ctx::clean_up() {
         } else {
             this->handle_cqes(cqe);
         }
+        this->run_deferred();
+    }
+    this->run_deferred();
+}
+
+
+int32_t ctx::setup_buf_ring(uint16_t group_id, uint32_t count, uint32_t size) {
+    int32_t ret = 0;
+    this->buf_ring = io_uring_setup_buf_ring(&ring, count, group_id, 0, &ret);
+    if (this->buf_ring == nullptr) {
+        return ret;
+    }
+    this->buf_storage = new std::byte[static_cast<size_t>(count) * size];
+    this->buf_count = count;
+    this->buf_size = size;
+    this->buf_group = group_id;
+
+    auto mask = io_uring_buf_ring_mask(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        io_uring_buf_ring_add(this->buf_ring, this->buf_at(i), size, i, mask, i);
     }
+    io_uring_buf_ring_advance(this->buf_ring, count);
+    return 0;
+}
+
+void ctx::recycle_buf(uint16_t buf_id) {
+    std::lock_guard lock(this->buf_mutex);
+    io_uring_buf_ring_add(this->buf_ring, this->buf_at(buf_id), this->buf_size, buf_id, io_uring_buf_ring_mask(this->buf_count), 0);
+    io_uring_buf_ring_advance(this->buf_ring, 1);
+}
+
+bool ctx::add_timer(timer& t, std::chrono::nanoseconds duration) {
+    // rounded up, a timer never expires early
+    auto expires = this->tick_of(std::chrono::steady_clock::now() + duration + this->tick_interval - 1ns);
+    bool start_ticking = false;
+    {
+        std::lock_guard lock(this->timer_mutex);
+        if (this->timers.empty()) {
+            // nothing to expire, only catch up with the clock
+            this->timers.advance(this->tick_of(std::chrono::steady_clock::now()), [](seele::structs::timer_node*) {});
+        }
+        t.owner = this;
+        t.expired.store(false, std::memory_order_relaxed);
+        t.generation.fetch_add(1, std::memory_order_release);
+        this->timers.add(&t, expires);
+        start_ticking = !std::exchange(this->tick.running, true);
+    }
+    if (start_ticking && !this->arm_ticker()) {
+        std::lock_guard lock(this->timer_mutex);
+        this->tick.running = false;
+        // it may have been expired by clean_up() in the meantime
+        return !this->timers.remove(&t);
+    }
+    return true;
+}
+
+bool ctx::remove_timer(timer& t) {
+    std::lock_guard lock(this->timer_mutex);
+    t.generation.fetch_add(1, std::memory_order_release);
+    return this->timers.remove(&t);
+}
+
+uint64_t ctx::tick_of(std::chrono::steady_clock::time_point time) const {
+    return static_cast<uint64_t>((time - this->tick_epoch) / this->tick_interval);
+}
+
+bool ctx::arm_ticker() {
+    return this->submit(
+        this,
+        [](void* helper_ptr, io_uring* ring) {
+            auto* self = static_cast<ctx*>(helper_ptr);
+            auto* sqe = io_uring_get_sqe(ring);
+            io_uring_prep_timeout(sqe, &self->tick.ts, 0, self->tick.multishot ? IORING_TIMEOUT_MULTISHOT : 0);
+            sqe->user_data = make_usr_data(op_kind::multishot, &self->tick);
+            return 1;
+        }
+    );
 }
 
+bool ctx::disarm_ticker() {
+    return this->submit(
+        this,
+        [](void* helper_ptr, io_uring* ring) {
+            auto* self = static_cast<ctx*>(helper_ptr);
+            auto* sqe = io_uring_get_sqe(ring);
+            io_uring_prep_timeout_remove(sqe, make_usr_data(op_kind::multishot, &self->tick), 0);
+            sqe->user_data = make_usr_data(op_kind::detached);
+            return 1;
+        }
+    );
+}
+
+// Ticks only while there are timers, an idle ring is not woken up for
+// nothing. add_timer() starts it again.
+void ctx::on_tick(multishot_usr_data* data, io_uring_cqe* cqe) {
+    auto& tick = *static_cast<ticker*>(data);
+    auto* self = tick.self;
+    if (cqe->res == -EINVAL && tick.multishot) {
+        log::async::warn("io_uring multishot timeouts are not supported, re-arming the timer tick");
+        tick.multishot = false;
+    }
+    self->expire_timers(false);
+
+    bool armed = cqe->flags & IORING_CQE_F_MORE;
+    bool disarm = false;
+    bool rearm = false;
+    {
+        std::lock_guard lock(self->timer_mutex);
+        bool idle = self->timers.empty();
+        if (armed) {
+            disarm = idle && !std::exchange(tick.stopping, true);
+        } else {
+            // timers added while it was being taken down start it again here
+            tick.stopping = false;
+            rearm = !idle;
+            tick.running = rearm;
+        }
+    }
+    if (disarm && !self->disarm_ticker()) {
+        // the ctx is closing, clean_up() removes it
+        std::lock_guard lock(self->timer_mutex);
+        tick.stopping = false;
+    }
+    if (rearm && !self->arm_ticker()) {
+        std::lock_guard lock(self->timer_mutex);
+        tick.running = false;
+    }
+}
+
+void ctx::expire_timers(bool drain) {
+    {
+        std::lock_guard lock(this->timer_mutex);
+        auto on_expire = [&](seele::structs::timer_node* node) {
+            this->fire(static_cast<timer*>(node), drain);
+        };
+        if (drain) {
+            this->timers.expire_all(on_expire);
+        } else {
+            this->timers.advance(this->tick_of(std::chrono::steady_clock::now()), on_expire);
+        }
+    }
+    for (auto handle : this->expired_handles) {
+        this->resume(handle);
+    }
+    this->expired_handles.clear();
+    for (auto* t : this->expired_callbacks) {
+        t->on_expire(t);
+    }
+    this->expired_callbacks.clear();
+    if (drain) {
+        this->flush_dispatch(); // not running inside handle_cqes()
+    }
+}
+
+void ctx::fire(timer* t, bool drain) {
+    t->expired.store(true, std::memory_order_release);
+    if (t->on_expire) {
+        this->expired_callbacks.push_back(t);
+        return;
+    }
+    if (t->fd < 0) {
+        this->expired_handles.push_back(t->handle);
+        return;
+    }
+    if (t->cancel_state.load(std::memory_order_acquire) != 0) {
+        return; // the one of an earlier expiry is still on its way
+    }
+    t->cancel_generation = t->generation.load(std::memory_order_relaxed);
+    t->cancel_state.store(timer::cancel_pending, std::memory_order_release);
+    if (drain) {
+        prep_cancel_fd(t, &ring);
+        this->pending_req_count.fetch_add(1, std::memory_order_acq_rel);
+        return;
+    }
+    if (!this->submit(t, &ctx::prep_cancel_fd)) {
+        // still under timer_mutex, a waiter is resumed once it is released
+        auto state = t->cancel_state.exchange(0, std::memory_order_acq_rel);
+        if (state != timer::cancel_pending) {
+            this->expired_handles.push_back(std::coroutine_handle<>::from_address(std::bit_cast<void*>(state)));
+        }
+    }
+}
+
+void ctx::on_cancel_done(multishot_usr_data* data, io_uring_cqe*) {
+    auto* t = static_cast<timer::cancel_op_t*>(data)->self;
+    t->owner->finish_cancel(t);
+}
+
+void ctx::finish_cancel(timer* t) {
+    // last access, the timer may be gone after this
+    auto state = t->cancel_state.exchange(0, std::memory_order_acq_rel);
+    if (state != timer::cancel_pending) {
+        this->resume(std::coroutine_handle<>::from_address(std::bit_cast<void*>(state)));
+    }
+}
+
+int ctx::prep_cancel_fd(void* helper_ptr, io_uring* ring) {
+    auto* t = static_cast<timer*>(helper_ptr);
+    auto* sqe = io_uring_get_sqe(ring);
+    if (t->generation.load(std::memory_order_acquire) == t->cancel_generation) {
+        io_uring_prep_cancel_fd(
+            sqe, t->fd,
+            IORING_ASYNC_CANCEL_ALL | (t->fixed_file ? IORING_ASYNC_CANCEL_FD_FIXED : 0)
+        );
+    } else {
+        // re-armed or cleared since it ran out, leave the fd alone
+        io_uring_prep_nop(sqe);
+    }
+    // the timer stays alive until this completes, see timer::cancel_state
+    sqe->user_data = make_usr_data(op_kind::multishot, &t->cancel_op);
+    return 1;
+}
 
 ctx::~ctx() {
+    if (this->buf_ring) {
+        io_uring_free_buf_ring(&ring, this->buf_ring, this->buf_count, this->buf_group);
+        delete[] this->buf_storage;
+    }
     io_uring_queue_exit(&ring);
 }
 
@@ -1,24 +1,57 @@
 #pragma once
 
 #include <atomic>
+#include <bit>
+#include <chrono>
 #include <coroutine>
 #include <cstddef>
 #include <liburing.h>
 #include <cstdint>
 #include <print>
-#include <semaphore>
 #include <string_view>
 #include <thread>
 #include <type_traits>
 #include <stop_token>
+#include <mutex>
+#include <vector>
 #include <cstring>
+#include <utility>
+#include "structs/blocking_queue.h"
 #include "structs/mpsc_queue.h"
-#include "structs/spsc_object_pool.h"
-constexpr size_t submit_threshold = 64;
+#include "structs/timer_wheel.h"
+#include "coro/threadpool.h"
+// cqes taken off the ring at once
+constexpr size_t cqe_batch = 256;
 
 namespace coro_io {
 
+// Where a coroutine continues once its request completed
+enum class resume_mode : uint8_t {
+    // always on the thread pool
+    dispatch,
+    // on the reaper thread if its awaiter asked for it with inline_resume(),
+    // for continuations that only issue the next request
+    selective,
+    // always on the reaper thread, the pool is not involved
+    run_to_completion,
+};
 
+struct ctx_options{
+    uint32_t entries = 128;
+    uint32_t flags = 0;
+    resume_mode resume = resume_mode::dispatch;
+    // inline resumptions per batch of cqes, past it the rest is dispatched
+    // (or, running to completion, deferred until the cq was looked at again)
+    uint32_t inline_budget = 64;
+    // the thread running the ctx writes SQEs into the ring itself and flushes
+    // them once per loop, no submitter thread or request queue involved.
+    // Implies run_to_completion.
+    bool direct_submit = false;
+    // spin on the cq this long before going to sleep, 0 sleeps right away
+    std::chrono::microseconds busy_poll{0};
+    // resolution of the timer wheel, one timeout request ticks it this often
+    std::chrono::nanoseconds tick = std::chrono::milliseconds{10};
+};
     
 class ctx{
 public:      
@@ -26,42 +59,71 @@ public:
         void* helper_ptr;
         auto (*ring_handle)(void*, io_uring*) -> int;
     };
-    struct io_usr_data;
-    struct timeout_usr_data;
-    struct multishot_usr_data;
-    using usr_data = std::variant<io_usr_data, timeout_usr_data>;
+    // The user_data of every SQE points at the completion state inside its
+    // awaiter, with the kind of request in the low bits.
+    enum class op_kind : uint64_t {
+        io = 0,         // io_usr_data, resumed with the result
+        timeout = 1,    // linked timeout of an io_usr_data, result is checked only
+        multishot = 2,  // multishot_usr_data, sees every cqe
+        detached = 3,   // nobody waits for it, the result is dropped
+    };
+    static constexpr uint64_t op_kind_mask = 0b11;
 
     struct io_usr_data{
         std::coroutine_handle<> handle;
-        std::atomic<int32_t>* io_ret;
+        std::atomic<int32_t> io_ret;
+        bool prefer_inline = false;
     };
 
-    struct timeout_usr_data{
-        usr_data* io_data;
+    struct multishot_usr_data{
+        auto (*on_cqe)(multishot_usr_data*, io_uring_cqe*) -> void;
     };
 
-    struct multishot_usr_data{
-        void (*callback)(int32_t);
+    static_assert(alignof(io_usr_data) > op_kind_mask && alignof(multishot_usr_data) > op_kind_mask);
+
+    // A deadline or a sleep on the timer wheel. When it expires every request
+    // on `fd` is cancelled, or `handle` is resumed if there is no fd.
+    // `on_expire` takes precedence over both and is called on the ring thread.
+    struct timer : seele::structs::timer_node {
+        static constexpr std::uintptr_t cancel_pending = 1;
+
+        struct cancel_op_t : multishot_usr_data {
+            timer* self;
+        };
+
+        std::coroutine_handle<> handle;
+        auto (*on_expire)(timer*) -> void = nullptr;
+        int fd = -1;
+        bool fixed_file = false;
+        // set when it runs out, until it is added again
+        std::atomic<bool> expired{false};
+        // Bumped whenever it is added or removed. The cancel of an expiry is
+        // dropped if the generation moved on before it was written, the fd
+        // may not be the same connection's anymore.
+        std::atomic<uint64_t> generation{0};
+        uint64_t cancel_generation = 0;
+        // 0, cancel_pending from the expiry until the cancel's cqe, or the
+        // address of the coroutine waiting for that cqe. Until then the fd
+        // must stay open and nothing new may be issued on it.
+        std::atomic<std::uintptr_t> cancel_state{0};
+        cancel_op_t cancel_op{{&ctx::on_cancel_done}, this};
+        // the ctx it was last added to
+        ctx* owner = nullptr;
     };
 
+    static inline uint64_t make_usr_data(op_kind kind, const void* data = nullptr) {
+        return std::bit_cast<std::uintptr_t>(data) | std::to_underlying(kind);
+    }
+
+
+    explicit ctx(const ctx_options& opts);
+    ~ctx();  
 
     ctx(const ctx&) = delete;
     ctx(ctx&&) = delete;
     ctx& operator=(const ctx&) = delete;
     ctx& operator=(ctx&&) = delete;
 
-    template<typename... args_t>
-    usr_data* new_usr_data(args_t&& ...args){
-        usr_data* data_ptr;
-        do {
-            data_ptr = this->usr_data_pool.allocate(
-                std::forward<args_t>(args)...
-            );
-        } while (data_ptr == nullptr);
-
-        return data_ptr;
-    }
-
     inline int32_t register_file_alloc_range(uint32_t off, uint32_t len) {
         return io_uring_register_file_alloc_range(&ring, off, len);
     }
@@ -77,46 +139,170 @@ public:
         return io_uring_unregister_files(&ring);
     }
 
+    // Registers `count` buffers of `size` bytes as provided buffer group `group_id`.
+    // The kernel picks one of them for every IOSQE_BUFFER_SELECT request and
+    // it stays out of the ring until recycle_buf() hands it back.
+    int32_t setup_buf_ring(uint16_t group_id, uint32_t count, uint32_t size);
+
+    inline std::byte* buf_at(uint16_t buf_id) {
+        return this->buf_storage + static_cast<size_t>(buf_id) * this->buf_size;
+    }
+
+    void recycle_buf(uint16_t buf_id);
+
+    // (Re)schedules `t` to expire after `duration`, rounded up to whole ticks.
+    // Returns false if the ctx is closed.
+    bool add_timer(timer& t, std::chrono::nanoseconds duration);
+
+    // Returns false if `t` wasn't scheduled, e.g. because it already expired
+    bool remove_timer(timer& t);
+
     inline bool submit(void* helper_ptr, auto (*ring_handle)(void*, io_uring*) -> int) {
+        if (this->direct_submit) {
+            if (std::this_thread::get_id() != this->issuer) {
+                // SINGLE_ISSUER, the kernel would reject the submit with -EEXIST
+                std::println("Direct submit from a thread that is not the ring's issuer");
+                std::terminate();
+            }
+            if (this->stop_src.stop_requested()) {
+                return false;
+            }
+            // keep room for a linked pair, flushing early if the SQ is full
+            if (io_uring_sq_space_left(&ring) < 2) {
+                io_uring_submit(&ring);
+            }
+            ring_handle(helper_ptr, &ring);
+            this->pending_req_count.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
         if (this->is_worker_running.load(std::memory_order_acquire)){
+            // wakes the worker only if it is parked
             this->unprocessed_requests.emplace_back(helper_ptr, ring_handle);
-            this->unp_sem.release();            
             return true;
         }
         return false;
     }
 
 
+    // Continues a coroutine whose request completed, on this thread or the pool.
+    // Only called on the reaper thread.
+    inline void resume(std::coroutine_handle<> handle, bool prefer_inline = false) {
+        if (this->mode == resume_mode::run_to_completion
+            || (prefer_inline && this->mode == resume_mode::selective)) {
+            if (this->inline_left > 0) {
+                this->inline_left--;
+                resuming_inline = this->mode == resume_mode::selective;
+                handle.resume();
+                resuming_inline = false;
+                return;
+            }
+            if (this->mode == resume_mode::run_to_completion) {
+                this->deferred.push_back(handle);
+                return;
+            }
+        }
+        this->dispatch_batch.push_back(handle);
+    }
+
     inline void request_stop() { stop_src.request_stop(); }
     
     inline void run(){ 
-        this->start_listen(stop_src.get_token());
+        if (this->direct_submit) {
+            this->start_direct(stop_src.get_token());
+        } else {
+            this->start_listen(stop_src.get_token());
+        }
         this->clean_up(); 
     }
 
     void clean_up();
 
+    // Makes this ctx the one `get_instance()` returns on the calling thread,
+    // so a shard thread keeps its own connections on its own ring.
+    // With direct_submit this thread becomes the only issuer of the ring.
+    void bind_local();
+
+    inline bool pin_worker(size_t cpu) {
+        if (!this->worker_thread.joinable()) {
+            return false;
+        }
+        return seele::coro::thread::set_affinity(this->worker_thread.native_handle(), cpu);
+    }
+
+    // Options of the shared instance, only takes effect before its first use
+    inline static void configure(const ctx_options& opts) {
+        default_options = opts;
+    }
+
     inline static ctx& get_instance() {
-        static ctx instance;
+        if (local_instance) {
+            return *local_instance;
+        }
+        static ctx instance{default_options};
         return instance;
     }
+
+    // A selective ctx is running an inline_resume() continuation on this
+    // thread, which should hand anything longer to the pool
+    inline static bool resumed_inline() {
+        return resuming_inline;
+    }
 private: 
+    inline static thread_local ctx* local_instance = nullptr;
+    inline static thread_local bool resuming_inline = false;
+    inline static ctx_options default_options{};
+
 
     void worker(std::stop_token st);
 
     void start_listen(std::stop_token st);
 
+    void start_direct(std::stop_token st);
+
     void handle_cqes(io_uring_cqe* cqe);
 
-    ctx(uint32_t entries = 128, uint32_t flags = 0) : max_entries{entries}, pending_req_count{0}, unp_sem{0}, usr_data_pool{1024*128} {
-        if(io_uring_queue_init(entries, &ring, flags) < 0) {
-            std::println("Failed to initialize io_uring");
-            std::terminate();
-        }
-        this->worker_thread = std::jthread([&] (std::stop_token st) { worker(st); }, stop_src.get_token());
-        this->is_worker_running.store(true, std::memory_order_release);
-    }
-    ~ctx();  
+    void handle_cqe(io_uring_cqe* cqe);
+
+    // Resumes the coroutines that were over the inline budget
+    void run_deferred();
+
+    // Hands everything resume() collected to the pool at once
+    void flush_dispatch();
+
+    // Spins for up to busy_poll until something completes, before the caller sleeps
+    bool poll_cq();
+
+    // The periodic timeout request driving the timer wheel
+    struct ticker : multishot_usr_data {
+        ctx* self;
+        __kernel_timespec ts;
+        // falls back to re-arming a plain timeout on kernels without multishot timeouts
+        bool multishot = true;
+        // guarded by timer_mutex
+        bool running = false;
+        // a multishot tick is being taken down because no timer is left,
+        // running stays set until its last cqe
+        bool stopping = false;
+    };
+
+    static void on_tick(multishot_usr_data* data, io_uring_cqe* cqe);
+
+    bool arm_ticker();
+
+    bool disarm_ticker();
+
+    // the tick `time` falls into
+    uint64_t tick_of(std::chrono::steady_clock::time_point time) const;
+
+    // `drain` writes the cancel requests straight into the ring, for clean_up()
+    void expire_timers(bool drain);
+
+    void fire(timer* t, bool drain);
+
+    static int prep_cancel_fd(void* helper_ptr, io_uring* ring);
+    static void on_cancel_done(multishot_usr_data* data, io_uring_cqe* cqe);
+    // lets go of the timer, resuming whoever waits for the cancel
+    void finish_cancel(timer* t);
 
 
 
@@ -125,11 +311,41 @@ private:
     std::jthread worker_thread; 
     std::atomic<bool> is_worker_running;
     const size_t max_entries;
+    const resume_mode mode;
+    const uint32_t inline_budget;
+    // reaper thread only
+    uint32_t inline_left = 0;
+    std::vector<std::coroutine_handle<>> deferred;
+    std::vector<std::coroutine_handle<>> running_deferred;
+    std::vector<std::coroutine_handle<>> dispatch_batch;
+    const std::chrono::nanoseconds busy_poll;
+    // completions only show up once this thread enters the kernel
+    bool defer_taskrun = false;
+    const bool direct_submit;
+    // the ring was created disabled and is enabled by its issuer in bind_local()
+    bool ring_disabled;
+    // the thread that called bind_local(), the only one writing SQEs with direct_submit
+    std::thread::id issuer;
     std::atomic<size_t> pending_req_count;
 
-    std::counting_semaphore<> unp_sem;
-    seele::structs::mpsc_queue<request> unprocessed_requests;
+    seele::structs::blocking_queue<seele::structs::mpsc_queue<request>> unprocessed_requests;
+
+    io_uring_buf_ring* buf_ring = nullptr;
+    std::byte* buf_storage = nullptr;
+    uint32_t buf_count = 0;
+    uint32_t buf_size = 0;
+    uint16_t buf_group = 0;
+    // buffers are handed back from whichever thread finished parsing them
+    std::mutex buf_mutex;
 
-    seele::structs::spsc_object_pool<usr_data> usr_data_pool;
+    const std::chrono::nanoseconds tick_interval;
+    const std::chrono::steady_clock::time_point tick_epoch;
+    ticker tick;
+    // timers are added from any thread and expired on the ring thread
+    std::mutex timer_mutex;
+    seele::structs::timer_wheel<> timers;
+    // sleepers that came due on this tick, resumed once timer_mutex is released
+    std::vector<std::coroutine_handle<>> expired_handles;
+    std::vector<timer*> expired_callbacks;
 };
 }
@@ -3,45 +3,32 @@
 #include <array>
 #include <cstdint>
 #include <expected>
+#include <forward_list>
 #include <optional>
 #include <string>
 #include <string_view>
-#include <type_traits>
 #include <utility>
 #include "meta.h"
 #include "math.h"
 #include "basic.h"
+#include "simd.h"
 using namespace seele;
 namespace http {
 using std::literals::operator""s;
 using std::literals::operator""ms;
 
 
-constexpr std::array<bool, 256> tchar_helper_map(){
-    std::array<bool, 256> tchar_map{};
-    for (auto& c :"0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz!#$%&'*+-.^_`|~"){
-        tchar_map[static_cast<unsigned char>(c)] = true;
-    }
-    return tchar_map;
-}
-
-constexpr bool is_tchar(char c) {
-    constexpr std::array<bool, 256> tchar_map = tchar_helper_map();
-    return tchar_map[static_cast<unsigned char>(c)];
-}
+constexpr simd::char_class header_value_chars{
+    "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz!#$%&'*+-.^_`|~ "
+};
 
-constexpr std::array<bool, 256> absolute_path_char_helper_map(){
-    std::array<bool, 256> char_map{};
-    for (auto& c :"0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz-._~!$&'()*+,;=:@/"){
-        char_map[static_cast<unsigned char>(c)] = true;
-    }
-    return char_map;
-}
+constexpr simd::char_class absolute_path_chars{
+    "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz-._~!$&'()*+,;=:@/"
+};
 
-constexpr bool is_absolute_path_char(char c){
-    constexpr std::array<bool, 256> char_map = absolute_path_char_helper_map();
-    return char_map[static_cast<unsigned char>(c)];
-}
+constexpr simd::char_class query_chars{
+    "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz-._~!$&'()*+,;=:@/?"
+};
 
 constexpr char pct_decode(const char* hex) {
     return static_cast<char>(basic::hex_to_int(hex[0]) << 4 | 
@@ -74,81 +61,51 @@ constexpr char HTAB = '\t';
 
 constexpr std::string_view CRLF = "\r\n";
 
-template <typename lambda_t>
-    requires std::is_same_v<bool, std::invoke_result_t<lambda_t, char>>
-std::string_view parse_token(std::string_view str, lambda_t&& is_valid) {
-    size_t end = 0;
-
-    for (auto c:str){
-        if (is_valid(c)) {
-            end++;
-        } else {
-            break;
-        }
-    }
-    return str.substr(0, end);
+std::string_view parse_token(std::string_view str, const simd::char_class& valid) {
+    return str.substr(0, simd::span(str, valid));
 }
 
-std::optional<std::string> parse_absolute_path(std::string_view path) {
-    std::string res;
-    for (auto it = path.cbegin(); it != path.cend(); ++it) {
-        if (!is_absolute_path_char(*it)) {
-            if (*it == '%' && (it + 1) != path.cend() && (it + 2) != path.cend()
-                && basic::is_hex_digit(it[1]) && basic::is_hex_digit(it[2])
-            ) {
-                res.push_back(pct_decode(it + 1));
-                it += 2; // Skip the next two characters
-            } else {
-                return std::nullopt;
-            }
-        } else {
-            res.push_back(*it);
-        }
-    }
-    return res;
+bool is_pct_encoded(std::string_view str) {
+    return str.size() >= 3 && str[0] == '%' 
+        && basic::is_hex_digit(str[1]) && basic::is_hex_digit(str[2]);
 }
 
-bool is_valid_absolute_query(std::string_view query){
-    for (auto it = query.cbegin(); it != query.cend(); ++it) {
-        if (!is_absolute_path_char(*it) && *it != '?') {
-            if (*it == '%' && (it + 1) != query.cend() && (it + 2) != query.cend()
-                && basic::is_hex_digit(it[1]) && basic::is_hex_digit(it[2])
-            ) {
-                it += 2; // Skip the next two characters
-            } else {
-                return false;
-            }
-        }
+// Length of the run of `valid` chars and %XX escapes `str` starts with,
+// `escaped` is set if there was an escape
+size_t span_escaped(std::string_view str, const simd::char_class& valid, bool& escaped) {
+    size_t end = simd::span(str, valid);
+    while (end < str.size() && is_pct_encoded(str.substr(end))) {
+        escaped = true;
+        end += 3; // Skip the escape
+        end += simd::span(str.substr(end), valid);
     }
-    return true;
+    return end;
 }
 
-
-
-std::optional<request_target_t> parse_request_target(std::string_view str) {
-    request_target_t target;
+std::optional<request_target_t> parse_request_target(std::string_view str, std::forward_list<std::string>& spill) {
     if (str.starts_with("/")){
-        // origin form
-        auto pos = str.find('?');
-        if (pos == std::string_view::npos){
-            auto path = parse_absolute_path(str);
-            if (!path.has_value()){
-                return std::nullopt; // Invalid path
+        // origin form, the scan of the path stops at the '?' of the query
+        bool escaped = false;
+        auto path_end = span_escaped(str, absolute_path_chars, escaped);
+        if (path_end != str.size() && str[path_end] != '?') {
+            return std::nullopt; // Invalid path
+        }
+        query_t query{};
+        if (path_end != str.size()) {
+            query = str.substr(path_end + 1);
+            bool query_escaped = false;
+            if (span_escaped(query, query_chars, query_escaped) != query.size()) {
+                return std::nullopt; // Invalid query
             }
-            return origin_form{
-                path.value(),
-                query_t{}
-            };
         }
-        auto path = parse_absolute_path(str.substr(0, pos));
-        auto query = str.substr(pos + 1);
-        auto is_query = is_valid_absolute_query(query);
-        if (!path || !is_query) {
-            return std::nullopt; // Invalid path or query
+        auto path = str.substr(0, path_end);
+        if (escaped) {
+            // only a path with escapes is copied
+            path = spill.emplace_front(pct_decode(path).value());
         }
         return origin_form{
-            path.value(),
-            std::string(query)
+            path,
+            query
         };
 
     }
@@ -169,114 +126,169 @@ std::string_view trim_string_view(std::string_view str) {
     return str.substr(start, end - start);
 }
 
-coro::sendable_task<std::optional<std::string_view>, std::string_view> req_msg::parser() {
-    using wait_message = coro::sendable_task<std::optional<std::string_view>, std::string_view>::wait_message;
-
-    std::string_view data = co_await wait_message{};
-
-
-    std::string line_buffer{};
-    std::string_view line_view{};
-
-    #define get_line()                                                              \
-    if (auto line_end = data.find(CRLF); line_end != std::string_view::npos){       \
-        line_view = data.substr(0, line_end);                                       \
-        data.remove_prefix(line_end + CRLF.size());                                 \
-    } else {                                                                        \
-        line_buffer.append(data);                                                   \
-        while (true) {                                                              \
-            data = co_await wait_message{};                                         \
-            auto line_end = data.find(CRLF);                                        \
-            if (line_end == std::string_view::npos) {                               \
-                /*If we don't find a complete line, wait for more data*/            \
-                line_buffer.append(data);                                           \
-            } else {                                                                \
-                line_buffer.append(data.substr(0, line_end));                       \
-                data.remove_prefix(line_end + CRLF.size());                         \
-                line_view = line_buffer;                                            \
-                break;                                                              \
-            }                                                                       \
-        }                                                                           \
-    }
+void req_msg::clear() {
+    this->line = {};
+    this->header.clear();
+    this->body = {};
+    this->spill.clear();
+    this->pinned = false;
+}
 
-    // Parse request line
-    get_line()
+void req_parser::reset() {
+    this->msg.clear();
+    this->state = state_t::request_line;
+    this->partial = nullptr;
+    this->content_length = 0;
+    this->result.reset();
+}
 
-    auto req_line_parts = basic::split_string_view(line_view, SP);
-    if (req_line_parts.size() != 3) {
-        co_return std::nullopt;
+void req_parser::send(std::string_view data) {
+    if (this->done()) {
+        return;
     }
-    auto method_opt = meta::enum_from_string<method_t>(req_line_parts[0]);
-    if (!method_opt) {
-        co_return std::nullopt;
+    this->msg.pinned = false;
+    if (this->state == state_t::body) {
+        this->read_body(data);
+        return;
     }
+    while (auto line = this->next_line(data)) {
+        if (this->state == state_t::request_line) {
+            if (!this->parse_request_line(*line)) {
+                this->finish(std::nullopt);
+                return;
+            }
+            this->state = state_t::header_line;
+        } else if (line->empty()) {
+            // the empty line ends the headers
+            this->start_body(data);
+            return;
+        } else if (!this->parse_header_line(*line)) {
+            this->finish(std::nullopt);
+            return;
+        }
+    }
+}
+
+void req_parser::finish(std::optional<std::string_view> leftover) {
+    this->result = leftover;
+    this->partial = nullptr;
+    this->state = state_t::done;
+}
 
+// A line that ends in `data` is viewed in place, one that runs past it is
+// gathered into a spill string, a CRLF split between two chunks included.
+// nullopt while the line is incomplete, all of `data` is used up then.
+std::optional<std::string_view> req_parser::next_line(std::string_view& data) {
+    if (this->partial == nullptr) {
+        if (auto line_end = simd::find_crlf(data); line_end != std::string_view::npos) {
+            auto line = data.substr(0, line_end);
+            data.remove_prefix(line_end + CRLF.size());
+            this->msg.pinned = true;
+            return line;
+        }
+        if (!data.empty()) {
+            this->partial = &this->msg.spill.emplace_front(data);
+            data = {};
+        }
+        return std::nullopt;
+    }
 
-    if (auto req_target = parse_request_target(req_line_parts[1]); req_target.has_value()) {
-        this->line = {
-            *method_opt,
-            std::move(req_target.value()),
-            std::string(req_line_parts[2])
-        };
+    auto& line_buffer = *this->partial;
+    if (line_buffer.ends_with(CR) && data.starts_with(LF)) {
+        line_buffer.pop_back();
+        data.remove_prefix(1);
+    } else if (auto line_end = simd::find_crlf(data); line_end != std::string_view::npos) {
+        line_buffer.append(data.substr(0, line_end));
+        data.remove_prefix(line_end + CRLF.size());
     } else {
-        co_return std::nullopt; // Invalid request target
+        /*If we don't find a complete line, wait for more data*/
+        line_buffer.append(data);
+        data = {};
+        return std::nullopt;
     }
+    this->partial = nullptr;
+    return line_buffer;
+}
 
+bool req_parser::parse_request_line(std::string_view line) {
+    auto method_end = line.find(SP);
+    auto target_end = method_end == std::string_view::npos 
+        ? std::string_view::npos 
+        : line.find(SP, method_end + 1);
+    if (target_end == std::string_view::npos || line.find(SP, target_end + 1) != std::string_view::npos) {
+        return false;
+    }
+    auto method_opt = meta::enum_from_string<method_t>(line.substr(0, method_end));
+    if (!method_opt) {
+        return false;
+    }
 
-    line_buffer.clear();
+    auto target = line.substr(method_end + 1, target_end - method_end - 1);
+    auto req_target = parse_request_target(target, this->msg.spill);
+    if (!req_target.has_value()) {
+        return false; // Invalid request target
+    }
+    this->msg.line = {
+        *method_opt,
+        std::move(req_target.value()),
+        line.substr(target_end + 1)
+    };
+    return true;
+}
 
+bool req_parser::parse_header_line(std::string_view line) {
+    auto key = parse_token(line, tchars);
+    line.remove_prefix(key.size());
+    if (key.empty()) {
+        return false;
+    }
+    if (line.empty() || line.front() != ':') {
+        return false; // Invalid header format
+    }
+    line.remove_prefix(1); // Skip ':'
 
-    // Parse headers
-    while (true) {
-        if (data.starts_with(CRLF)) {
-            data.remove_prefix(CRLF.size());
-            break;
-        }
-        get_line()
-        auto key = parse_token(line_view, is_tchar);
-        line_view.remove_prefix(key.size());
-        if (key.empty()) {
-            co_return std::nullopt;
-        }
-        if (line_view.empty() || line_view.front() != ':') {
-            co_return std::nullopt; // Invalid header format
-        }
-        line_view.remove_prefix(1); // Skip ':'
+    auto value = parse_token(line, header_value_chars);
+    if (value.empty()) {
+        return false; // Invalid header format
+    }
 
-        auto value = parse_token(line_view, [](char c){return is_tchar(c) || c == ' ';});
-        line_view.remove_prefix(value.size());
-        if (value.empty()) {
-            co_return std::nullopt; // Invalid header format
-        }
+    this->msg.header.emplace(trim_string_view(key), trim_string_view(value));
+    return true;
+}
 
-        this->header.emplace(trim_string_view(key), trim_string_view(value));
-        line_buffer.clear();
+// Reads the body if Content-Length is present
+void req_parser::start_body(std::string_view data) {
+    auto content_length_it = this->msg.header.find(header_name::content_length);
+    if (content_length_it == this->msg.header.end()) {
+        this->finish(data);
+        return;
     }
-
-    // Parse body if Content-Length is present
-    std::string body_buffer;
-    if(auto content_length_it = this->header.find("Content-Length"); content_length_it != this->header.end()) {
-        if (auto res = math::stoi(content_length_it->second); res.has_value()){
-            size_t content_length = res.value();
-            if (content_length > 0) {
-                while (body_buffer.size() < content_length) {
-                    auto need_to_read = content_length - body_buffer.size();
-                    if (need_to_read > data.size()) {
-                        body_buffer.append(data);
-                        data = co_await wait_message{};;
-                    } else {
-                        body_buffer.append(data.substr(0, need_to_read));
-                        data.remove_prefix(need_to_read);
-                    }
-                }
-                this->body = std::move(body_buffer);
-            }
-        } else {
-            co_return std::nullopt; // Invalid Content-Length value
-        }
+    auto res = math::stoi(content_length_it->second);
+    if (!res.has_value()) {
+        this->finish(std::nullopt); // Invalid Content-Length value
+        return;
     }
+    this->content_length = res.value();
+    if (this->content_length <= data.size()) {
+        this->msg.body = data.substr(0, this->content_length);
+        data.remove_prefix(this->content_length);
+        this->msg.pinned = this->msg.pinned || this->content_length > 0;
+        this->finish(data);
+    } else {
+        this->partial = &this->msg.spill.emplace_front(data);
+        this->state = state_t::body;
+    }
+}
 
-    co_return data;
+void req_parser::read_body(std::string_view data) {
+    auto& body_buffer = *this->partial;
+    auto need_to_read = std::min(this->content_length - body_buffer.size(), data.size());
+    body_buffer.append(data.substr(0, need_to_read));
+    data.remove_prefix(need_to_read);
+    if (body_buffer.size() == this->content_length) {
+        this->msg.body = body_buffer;
+        this->finish(data);
+    }
 }
 phrase_content_map phrase_contents = {
     {status_code::ok, "OK"},
@@ -471,7 +483,7 @@ error_content_map error_contents = {
 };
 
 
-std::unordered_map<std::string, std::string> mime_types = {
+constexpr std::pair<std::string_view, std::string_view> mime_types[] = {
     // Text and Web Files
     {".html", "text/html"},
     {".htm", "text/html"},
@@ -582,4 +594,19 @@ std::unordered_map<std::string, std::string> mime_types = {
     {".torrent", "application/x-bittorrent"},
     {".epub", "application/epub+zip"}
 };
+
+constexpr meta::perfect_hash mime_type_hash{[] {
+    std::array<std::string_view, std::size(mime_types)> exts;
+    for (size_t i = 0; i < exts.size(); ++i) {
+        exts[i] = mime_types[i].first;
+    }
+    return exts;
+}()};
+
+std::optional<std::string_view> mime_type(std::string_view ext) {
+    if (auto index = mime_type_hash.find(ext)) {
+        return mime_types[*index].second;
+    }
+    return std::nullopt;
+}
 }
\ No newline at end of file
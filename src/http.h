@@ -1,16 +1,22 @@
 #pragma once
+#include <algorithm>
+#include <array>
 #include <cstddef>
+#include <cstdint>
 #include <format>
+#include <forward_list>
+#include <initializer_list>
 #include <optional>
 #include <string>
 #include <string_view>
 #include <tuple>
-#include <unordered_map>
 #include <utility>
 #include <vector>
+#include "basic.h"
 #include "meta.h"
-#include "coro/sendable_task.h"
+#include "simd.h"
 #include "coro/task.h"
+#include "structs/small_vector.h"
 
 
 
@@ -28,12 +34,167 @@ enum method_t {
     CONNECT,
     TRACE
 };     
-using header_t = std::unordered_map<std::string, std::string>;
-using query_t = std::string;
+// Header names the server reads or writes, interned when a field is added
+enum class header_name : uint8_t {
+    accept,
+    accept_encoding,
+    accept_language,
+    cache_control,
+    connection,
+    content_encoding,
+    content_length,
+    content_type,
+    cookie,
+    date,
+    etag,
+    expect,
+    host,
+    if_modified_since,
+    if_none_match,
+    keep_alive,
+    last_modified,
+    location,
+    range,
+    server,
+    set_cookie,
+    transfer_encoding,
+    upgrade,
+    user_agent,
+    x_content_type_options,
+};
+
+// indexed by header_name
+constexpr std::array<std::string_view, 25> header_names{
+    "Accept",
+    "Accept-Encoding",
+    "Accept-Language",
+    "Cache-Control",
+    "Connection",
+    "Content-Encoding",
+    "Content-Length",
+    "Content-Type",
+    "Cookie",
+    "Date",
+    "ETag",
+    "Expect",
+    "Host",
+    "If-Modified-Since",
+    "If-None-Match",
+    "Keep-Alive",
+    "Last-Modified",
+    "Location",
+    "Range",
+    "Server",
+    "Set-Cookie",
+    "Transfer-Encoding",
+    "Upgrade",
+    "User-Agent",
+    "X-Content-Type-Options",
+};
+
+constexpr meta::perfect_hash<header_names.size(), true> header_name_hash{header_names};
+
+// The header_name spelled `name` in any case, nullopt for the rest
+constexpr std::optional<header_name> intern_header(std::string_view name) {
+    if (auto index = header_name_hash.find(name)) {
+        return static_cast<header_name>(*index);
+    }
+    return std::nullopt;
+}
+
+// Characters of a token (RFC 9110 5.6.2), e.g. a method or a field name
+constexpr simd::char_class tchars{
+    "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz!#$%&'*+-.^_`|~"
+};
+
+// Header fields in arrival order, the first N stored inline. Every
+// header_name also gets the position of its first field, so looking one up
+// is an index; other names are compared case-insensitively field by field.
+// string_t is std::string_view for requests parsed in place and std::string
+// for responses.
+template<typename string_t, size_t N>
+class header_map {
+public:
+    using value_type = std::pair<string_t, string_t>;
+    using const_iterator = const value_type*;
+
+    header_map() { this->known.fill(none); }
+
+    header_map(std::initializer_list<std::pair<std::string_view, std::string_view>> fields) : header_map() {
+        for (const auto& [name, value] : fields) {
+            this->emplace(name, value);
+        }
+    }
+
+    // Appends a field, lookups of a repeated name find the first one
+    template<typename value_t>
+    void emplace(std::string_view name, value_t&& value) {
+        if (auto id = intern_header(name); id && this->known[static_cast<size_t>(*id)] == none) {
+            this->known[static_cast<size_t>(*id)] = static_cast<uint32_t>(this->fields.size());
+        }
+        this->fields.emplace_back(string_t(name), string_t(std::forward<value_t>(value)));
+    }
+
+    // Appends a field unless `name` is already there
+    template<typename value_t>
+    bool try_emplace(std::string_view name, value_t&& value) {
+        if (this->find(name) != this->end()) {
+            return false;
+        }
+        this->emplace(name, std::forward<value_t>(value));
+        return true;
+    }
+
+    // Replaces the value of the first field named `name`, or appends one
+    template<typename value_t>
+    void insert_or_assign(std::string_view name, value_t&& value) {
+        if (auto it = this->find(name); it != this->end()) {
+            this->fields[it - this->begin()].second = string_t(std::forward<value_t>(value));
+        } else {
+            this->emplace(name, std::forward<value_t>(value));
+        }
+    }
+
+    const_iterator find(header_name name) const {
+        auto pos = this->known[static_cast<size_t>(name)];
+        return pos == none ? this->end() : this->begin() + pos;
+    }
+
+    const_iterator find(std::string_view name) const {
+        if (auto id = intern_header(name)) {
+            return this->find(*id);
+        }
+        return std::ranges::find_if(*this, [name](const value_type& field) {
+            return basic::iequals(field.first, name);
+        });
+    }
+
+    const_iterator begin() const { return this->fields.begin(); }
+    const_iterator end() const { return this->fields.end(); }
+    size_t size() const { return this->fields.size(); }
+    bool empty() const { return this->fields.empty(); }
+
+    // keeps the capacity for the next message
+    void clear() {
+        this->fields.clear();
+        this->known.fill(none);
+    }
+private:
+    static constexpr uint32_t none = UINT32_MAX;
+
+    seele::structs::small_vector<value_type, N> fields;
+    std::array<uint32_t, header_names.size()> known;
+};
+
+// responses rarely carry more than a handful of fields
+using header_t = header_map<std::string, 4>;
+using req_header_t = header_map<std::string_view, 16>;
+using query_t = std::string_view;
 using body_t = std::string;
 
 struct origin_form{
-    std::string path;
+    // %-decoded
+    std::string_view path;
     query_t query;
 };
 struct absolute_form{};
@@ -47,17 +208,71 @@ using request_target_t = std::variant<
 struct req_line {
     method_t method;
     request_target_t target;
-    std::string version;
+    std::string_view version;
 };
 
+using req_body_t = std::string_view;
 
-
+// A request parsed in place: every view points into the chunks fed to the
+// parser, which the caller keeps alive until the response is sent. Only a
+// line or body split across chunks and a %-escaped path get copied.
 struct req_msg {
     req_line line;
-    header_t header;
-    body_t body;
+    req_header_t header;
+    req_body_t body;
 
-    coro::sendable_task<std::optional<std::string_view>, std::string_view> parser();
+    // Whether the request points into the chunk sent last. If not, and the
+    // parser is not done, that chunk can be handed back right away.
+    bool holds_last_chunk() const { return this->pinned; }
+
+    // Drops the last request, keeping capacity for the next one
+    void clear();
+private:
+    friend class req_parser;
+
+    std::forward_list<std::string> spill;
+    bool pinned = false;
+};
+
+// Parses one request at a time into a req_msg, fed chunk by chunk with
+// send() until done(). It is a plain state machine, a connection keeps one
+// and reset()s it for every request, so parsing allocates nothing unless a
+// line or body is split across chunks or a path has escapes.
+class req_parser {
+public:
+    explicit req_parser(req_msg& msg) : msg(msg) {}
+
+    // Clears the message and starts on the next request
+    void reset();
+
+    void send(std::string_view data);
+
+    bool done() const { return this->state == state_t::done; }
+
+    // Once done: what the chunk sent last holds past the request, nullopt
+    // if the request is malformed
+    const std::optional<std::string_view>& get() const { return this->result; }
+private:
+    enum class state_t {
+        request_line,
+        header_line,
+        body,
+        done,
+    };
+
+    std::optional<std::string_view> next_line(std::string_view& data);
+    bool parse_request_line(std::string_view line);
+    bool parse_header_line(std::string_view line);
+    void start_body(std::string_view data);
+    void read_body(std::string_view data);
+    void finish(std::optional<std::string_view> leftover);
+
+    req_msg& msg;
+    state_t state = state_t::request_line;
+    // the front of msg.spill while a line or body is split across chunks
+    std::string* partial = nullptr;
+    size_t content_length = 0;
+    std::optional<std::string_view> result;
 };
 
 
@@ -123,7 +338,7 @@ public:
     res_msg(status_code code, header_t header, body_t body = "") : 
     stat_l(code), header(std::move(header)), body(std::move(body)) {
         if (!this->body.empty()) {
-            this->header.emplace("Content-Length", std::to_string(this->body.size()));
+            this->header.try_emplace("Content-Length", std::to_string(this->body.size()));
         }
 
     }
@@ -184,7 +399,9 @@ struct error_content_map{
 
 
 extern error_content_map error_contents;
-extern std::unordered_map<std::string, std::string> mime_types;
+
+// Content type for a file extension with its dot, like ".html"
+std::optional<std::string_view> mime_type(std::string_view ext);
 
 std::optional<std::string> pct_decode(std::string_view str);
 }
@@ -1,3 +1,4 @@
+#include <chrono>
 #include <cmath>
 #include <expected>
 #include <optional>
@@ -7,6 +8,7 @@
 #include "opts.h"
 #include "meta.h"
 #include "log.h"
+#include "math.h"
 #include "server.h"
 using namespace seele;
 using namespace seele::meta;
@@ -15,7 +17,20 @@ int main(int argc, char* argv[]) {
     log::logger().set_output_file("web_server.log");
     auto opts = opts::make_opts(
         opts::ruler::req_arg("--address", "-a"),
-        opts::ruler::req_arg("--path", "-p")
+        opts::ruler::req_arg("--path", "-p"),
+        opts::ruler::req_arg("--shards", "-s"),
+        opts::ruler::req_arg("--workers", "-w"),
+        opts::ruler::req_arg("--ring-entries"),
+        opts::ruler::no_arg("--run-to-completion"),
+        opts::ruler::no_arg("--selective-resume"),
+        opts::ruler::req_arg("--inline-budget"),
+        opts::ruler::req_arg("--busy-poll"),
+        opts::ruler::no_arg("--pin-cpu"),
+        opts::ruler::req_arg("--numa-node"),
+        opts::ruler::no_arg("--direct-submit"),
+        opts::ruler::no_arg("--fixed-files"),
+        opts::ruler::req_arg("--max-connections"),
+        opts::ruler::req_arg("--zc-threshold")
     );
 
     auto res = opts.parse(argc, argv);
@@ -28,6 +43,78 @@ int main(int argc, char* argv[]) {
                             app().set_addr(arg.value);
                         } else if (arg.long_name == "--path") {
                             app().set_root_path(arg.value);
+                        } else if (arg.long_name == "--shards") {
+                            if (auto count = math::stoi(arg.value); count.has_value()) {
+                                app().set_shards(count.value());
+                            } else {
+                                std::println("Invalid shard count: {}", arg.value);
+                                std::terminate();
+                            }
+                        } else if (arg.long_name == "--workers") {
+                            if (auto count = math::stoi(arg.value); count.has_value()) {
+                                app().set_workers(count.value());
+                            } else {
+                                std::println("Invalid worker count: {}", arg.value);
+                                std::terminate();
+                            }
+                        } else if (arg.long_name == "--ring-entries") {
+                            if (auto entries = math::stoi(arg.value); entries.has_value()) {
+                                app().set_ring_entries(entries.value());
+                            } else {
+                                std::println("Invalid ring size: {}", arg.value);
+                                std::terminate();
+                            }
+                        } else if (arg.long_name == "--inline-budget") {
+                            if (auto budget = math::stoi(arg.value); budget.has_value()) {
+                                app().set_inline_budget(budget.value());
+                            } else {
+                                std::println("Invalid inline budget: {}", arg.value);
+                                std::terminate();
+                            }
+                        } else if (arg.long_name == "--busy-poll") {
+                            if (auto us = math::stoi(arg.value); us.has_value()) {
+                                app().set_busy_poll(std::chrono::microseconds{us.value()});
+                            } else {
+                                std::println("Invalid busy poll window: {}", arg.value);
+                                std::terminate();
+                            }
+                        } else if (arg.long_name == "--numa-node") {
+                            if (auto node = math::stoi(arg.value); node.has_value()) {
+                                app().set_numa_node(node.value());
+                            } else {
+                                std::println("Invalid NUMA node: {}", arg.value);
+                                std::terminate();
+                            }
+                        } else if (arg.long_name == "--max-connections") {
+                            if (auto count = math::stoi(arg.value); count.has_value()) {
+                                app().set_max_connections(count.value());
+                            } else {
+                                std::println("Invalid connection limit: {}", arg.value);
+                                std::terminate();
+                            }
+                        } else if (arg.long_name == "--zc-threshold") {
+                            if (auto size = math::stoi(arg.value); size.has_value()) {
+                                app().set_zero_copy_threshold(size.value());
+                            } else {
+                                std::println("Invalid zero-copy threshold: {}", arg.value);
+                                std::terminate();
+                            }
+                        } else {
+                            std::println("Unknown option: {}", arg.long_name);
+                            std::terminate();
+                        }
+                    },
+                    [](opts::no_arg& arg){
+                        if (arg.long_name == "--pin-cpu"){
+                            app().set_cpu_pinning(true);
+                        } else if (arg.long_name == "--run-to-completion") {
+                            app().set_run_to_completion(true);
+                        } else if (arg.long_name == "--selective-resume") {
+                            app().set_selective_resume(true);
+                        } else if (arg.long_name == "--direct-submit") {
+                            app().set_direct_submit(true);
+                        } else if (arg.long_name == "--fixed-files") {
+                            app().set_fixed_files(true);
                         } else {
                             std::println("Unknown option: {}", arg.long_name);
                             std::terminate();
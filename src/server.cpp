@@ -1,6 +1,7 @@
 #include "server.h"
 
 
+#include <algorithm>
 #include <atomic>
 #include <cerrno>
 #include <coroutine>
@@ -18,9 +19,13 @@
 #include <unordered_map>
 #include <filesystem>
 #include <csignal>
+#include <memory>
+#include <thread>
+#include <pthread.h>
 #include <utility>
 #include <vector>
 
+#include "basic.h"
 #include "coro/lazy_task.h"
 #include "coro/task.h"
 #include "coro/threadpool.h"
@@ -42,6 +47,44 @@ namespace env {
     static std::filesystem::path root_path = std::filesystem::current_path() / "www";
     static net::ipv4 addr;
     static std::vector<fd_wrapper> accepter_fd_list;
+    static bool sharded = false;
+    // 0 picks one per usable CPU, the same goes for pool workers
+    static size_t shard_count = 0;
+    static size_t worker_count = 0;
+    static uint32_t ring_entries = 128;
+    // unsharded, every coroutine continues on the ring thread instead of the pool
+    static bool run_to_completion = false;
+    static bool selective_resume = false;
+    static uint32_t inline_budget = 64;
+    static std::chrono::microseconds busy_poll{0};
+    static bool cpu_pinning = false;
+    // keeps every thread on the CPUs of this node, -1 for all usable CPUs
+    static int32_t numa_node = -1;
+    static bool direct_submit = false;
+    // connection sockets live in the ring's registered file table, fds are slot indices
+    static bool fixed_files = false;
+    static uint32_t max_connections = 65536;
+    // responses at least this large go out with zero-copy sends, 0 disables
+    static uint32_t zero_copy_threshold = 64 * 1024;
+    static std::atomic<bool> zero_copy_supported = true;
+    static std::vector<std::unique_ptr<coro_io::ctx>> shards;
+
+    constexpr uint16_t recv_buf_group = 0;
+    constexpr uint32_t recv_buf_count = 4096;
+    constexpr uint32_t recv_buf_size = 4096;
+
+    void setup_ring(coro_io::ctx& io_ctx) {
+        if (auto ret = io_ctx.setup_buf_ring(recv_buf_group, recv_buf_count, recv_buf_size); ret < 0) {
+            std::println("Failed to setup provided buffer ring: {}", strerror(-ret));
+            std::terminate();
+        }
+        if (fixed_files) {
+            if (auto ret = io_ctx.register_files_sparse(max_connections); ret < 0) {
+                std::println("Failed to register file table: {}", strerror(-ret));
+                std::terminate();
+            }
+        }
+    }
     static std::unordered_map<std::string, mmap_wrapper> file_caches{};
 
     std::expected<iovec, http::status_code> get_file_cache(const std::filesystem::path& path) {
@@ -57,10 +100,21 @@ namespace env {
 
 
 
-    static std::unordered_map<std::string, GET_route_handler_t> get_routings;
-    static std::unordered_map<std::string, POST_route_handler_t> post_routings;
+    // looked up by the string_view paths of requests
+    static std::unordered_map<std::string, GET_route_handler_t, basic::string_hash, std::equal_to<>> get_routings;
+    static std::unordered_map<std::string, POST_route_handler_t, basic::string_hash, std::equal_to<>> post_routings;
 }
 
+// In sharded mode a connection stays on the shard that accepted it,
+// otherwise it is handed over to the thread pool.
+struct schedule_awaiter{
+    bool await_ready() { return env::sharded; }
+    void await_suspend(std::coroutine_handle<> handle) {
+        coro::thread::dispatch(handle);
+    }
+    void await_resume() {}
+};
+
 struct wait_promise_init{
     send_task::promise_type* promise;
     auto await_ready() { return false;}
@@ -71,6 +125,25 @@ struct wait_promise_init{
     auto await_resume() {return promise;}
 };
 
+std::coroutine_handle<> send_task::promise_type::final_awaiter::await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+    if (coro_io::ctx::resumed_inline()) {
+        // h may be destroyed as soon as the pool has the caller
+        coro::thread::dispatch(h.promise().previous);
+        return std::noop_coroutine();
+    }
+    return h.promise().previous;
+}
+
+// The deadline may run out while no write is in flight, there is nothing to
+// cancel then and the next write has to fail on its own
+bool timed_out(send_task::promise_type* promise) {
+    if (promise->deadline && promise->deadline->expired()) {
+        log::async::error("Timed out sending to {}", promise->client_addr.toString());
+        return true;
+    }
+    return false;
+}
+
 
 task send_http_error(http::status_code code){
     return [](http::status_code code) -> send_task {
@@ -88,10 +161,10 @@ task send_http_error(http::status_code code){
         );
         auto promise = co_await wait_promise_init{};
         auto fd = promise->fd;
-        co_await coro_io::awaiter::link_timeout{
-            coro_io::awaiter::writev{fd, &ctx.header, 2},
-            200ms
-        };
+        if (timed_out(promise)) {
+            co_return -1;
+        }
+        co_await coro_io::awaiter::writev{fd, &ctx.header, 2, 0, env::fixed_files}.inline_resume();
 
         co_return -1;
     }(code);
@@ -105,20 +178,30 @@ task send_file(http_file_ctx&& ctx){
 
         auto fd = promise->fd;
         auto client_addr = promise->client_addr;
-        auto timeout = promise->timeout;
 
 
 
         uint32_t total_size = file_ctx.size();
         uint32_t sent_size = 0;
-        int32_t res = co_await coro_io::awaiter::link_timeout{
-            coro_io::awaiter::writev{
-                fd,
-                &file_ctx.header,
-                2
-            },
-            timeout
-        };
+        bool zero_copy = env::zero_copy_threshold != 0 
+            && total_size >= env::zero_copy_threshold
+            && env::zero_copy_supported.load(std::memory_order_relaxed);
+        int32_t res = 0;
+        if (timed_out(promise)) {
+            co_return -1;
+        }
+        if (zero_copy) {
+            res = co_await coro_io::awaiter::sendmsg_zc{fd, &file_ctx.header, 2, MSG_NOSIGNAL, env::fixed_files}.inline_resume();
+            // the socket or kernel can't do it, stay on copying sends from now on
+            if (res == coro_io::error::SYS 
+                && (coro_io::error::code == EOPNOTSUPP || coro_io::error::code == EINVAL)) {
+                env::zero_copy_supported.store(false, std::memory_order_relaxed);
+                zero_copy = false;
+            }
+        }
+        if (!zero_copy) {
+            res = co_await coro_io::awaiter::writev{fd, &file_ctx.header, 2, 0, env::fixed_files}.inline_resume();
+        }
 
         if (res <= 0) {
             log::async::error(
@@ -130,15 +213,15 @@ task send_file(http_file_ctx&& ctx){
         sent_size += res;
 
         while (sent_size < total_size) {
+            if (timed_out(promise)) {
+                co_return -1;
+            }
             auto offset = file_ctx.offset_of(sent_size);
-            res = co_await coro_io::awaiter::link_timeout{
-                coro_io::awaiter::writev{
-                    fd,
-                    &offset,
-                    1
-                },
-                timeout
-            };
+            if (zero_copy) {
+                res = co_await coro_io::awaiter::send_zc{fd, offset.iov_base, offset.iov_len, MSG_NOSIGNAL, env::fixed_files}.inline_resume();
+            } else {
+                res = co_await coro_io::awaiter::writev{fd, &offset, 1, 0, env::fixed_files}.inline_resume();
+            }
             if (res <= 0) {
                 log::async::error(
                     "Failed to send response header for {} : {}", 
@@ -161,22 +244,17 @@ task send_msg(const http::res_msg& msg){
 
         auto fd = promise->fd;
         auto client_addr = promise->client_addr;
-        auto timeout = promise->timeout;
 
         
         uint32_t total_size = static_cast<uint32_t>(str.size());
         uint32_t sent_size = 0;
         while (sent_size < total_size) {
+            if (timed_out(promise)) {
+                co_return -1;
+            }
             auto offset = str.data() + sent_size;
             auto remaining_size = total_size - sent_size;
-            int32_t res = co_await coro_io::awaiter::link_timeout{
-                coro_io::awaiter::write{
-                    fd,
-                    offset,
-                    remaining_size
-                },
-                timeout
-            };
+            int32_t res = co_await coro_io::awaiter::write{fd, offset, remaining_size, 0, env::fixed_files}.inline_resume();
             if (res <= 0) {
                 log::async::error(
                     "Failed to send response header for {} : {}", 
@@ -217,12 +295,8 @@ task handle_file_get(const http::req_msg& req){
         return send_http_error(ctx.error());
     } else {
 
-        std::string content_type = "application/octet-stream";
         std::string ext = full_path.extension().string();
-
-        if (auto it = http::mime_types.find(ext);it != http::mime_types.end()) {
-            content_type = it->second;
-        }
+        auto content_type = http::mime_type(ext).value_or("application/octet-stream");
 
         return send_file(
             http_file_ctx::make(
@@ -273,84 +347,160 @@ task handle_req(const http::req_msg& req){
 
 
 coro::simple_task async_handle_connection(int fd, net::ipv4 addr) {
-    fd_wrapper fd_w(fd);
+    // fixed file slots are closed through the ring below
+    fd_wrapper fd_w(env::fixed_files ? -1 : fd);
     net::ipv4 client_addr = addr;
-    co_await coro::thread::dispatch_awaiter{};
+    co_await schedule_awaiter{};
 
-    char read_buffer[8192];
-    std::string_view buffer_view;
+    auto& io_ctx = coro_io::ctx::get_instance();
     auto timeout = 500ms;
-    while (true) {
-        http::req_msg msg{};
-        auto parser = msg.parser();
+    // No buffer is held while the connection is idle, the kernel picks one
+    // from the ring when data arrives and the parser hands it back.
+    coro_io::awaiter::multishot_recv receiver{fd, env::recv_buf_group, env::fixed_files};
+    // Covers both waiting for a request and writing the response, it cancels
+    // everything on the socket when it runs out.
+    coro_io::awaiter::deadline deadline{fd, env::fixed_files};
+    receiver.bind_deadline(deadline.timer);
+    bool recv_done = false;
+    deadline.arm(timeout);
+
+    std::string_view buffer_view;
+    // Buffers the request being handled points into, the last one also holds
+    // the leftover of the request before (buffer_view)
+    std::vector<int32_t> held_bufs;
+    // hands back all held buffers but the last `keep`
+    auto release_held = [&](size_t keep) {
+        size_t count = held_bufs.size() > keep ? held_bufs.size() - keep : 0;
+        for (size_t i = 0; i < count; ++i) {
+            io_ctx.recycle_buf(held_bufs[i]);
+        }
+        held_bufs.erase(held_bufs.begin(), held_bufs.begin() + count);
+    };
+    http::req_msg msg{};
+    http::req_parser parser{msg};
+    bool alive = true;
+    while (alive) {
+        parser.reset();
 
         if (!buffer_view.empty()) {
-            parser.send_and_resume(buffer_view);
+            parser.send(buffer_view);
+            if (!parser.done() && !msg.holds_last_chunk()) {
+                release_held(0);
+            }
         }
         while (!parser.done()) {
-            int32_t res = co_await coro_io::awaiter::link_timeout{
-                coro_io::awaiter::read{fd_w.get(), read_buffer, sizeof(read_buffer)},
-                timeout
-            };
+            // ran out while nothing was waiting for data, e.g. before the first recv
+            if (deadline.expired()) {
+                log::async::error("Failed to read from {}: Time out.", client_addr.toString());
+                alive = false;
+                break;
+            }
+            auto [res, flags, last] = co_await receiver.next();
+            recv_done = last;
 
-            if (auto bytes_read = res; bytes_read <= 0) {
+            if (res <= 0) {
                 log::async::error("Failed to read from {}: {}", 
-                    client_addr.toString(), coro_io::error::msg
+                    client_addr.toString(), 
+                    deadline.clear() ? coro_io::error::msg : "Time out."
                 );
-                co_return;
+                alive = false;
+                break;
+            }
+            auto buf_id = coro_io::awaiter::multishot_recv::buf_id(flags);
+            parser.send({reinterpret_cast<char*>(io_ctx.buf_at(buf_id)), static_cast<size_t>(res)});
+            if (parser.done() || msg.holds_last_chunk()) {
+                held_bufs.push_back(buf_id);
             } else {
-                parser.send_and_resume({read_buffer, static_cast<size_t>(bytes_read)});
+                io_ctx.recycle_buf(buf_id); // the parser copied what it still needs
             }
         }
+        if (!alive) {
+            break;
+        }
 
-        if (auto result = parser.get(); result.has_value()) {
+        if (const auto& result = parser.get(); result.has_value()) {
 
             buffer_view = result.value();
 
-            if (auto it = msg.header.find("Connection"); it != msg.header.end()) {
-                if (it->second == "close") {
-                    co_return; // Close connection immediately
-                } else if (it->second == "keep-alive") {
+            if (auto it = msg.header.find(http::header_name::connection); it != msg.header.end()) {
+                if (basic::iequals(it->second, "close")) {
+                    break; // Close connection immediately
+                } else if (basic::iequals(it->second, "keep-alive")) {
                     timeout = 1000ms; // Keep-alive timeout
                 }
             }
 
-            if (co_await handle_req(msg).await(fd_w.get(), client_addr, timeout) < 0) {
-                co_return;
+            // ran out while the request was parsed, or while the response was written
+            if (!co_await deadline.rearm(timeout)) {
+                break;
             }
+            if (co_await handle_req(msg).await(fd, client_addr, deadline) < 0) {
+                break;
+            }
+            if (!co_await deadline.rearm(timeout)) {
+                break;
+            }
+            release_held(buffer_view.empty() ? 0 : 1);
 
         } else {
             log::async::error("Failed to parse request from {}", client_addr.toString());
-            co_await send_http_error(http::status_code::bad_request).await(fd_w.get(), client_addr, timeout);
-            co_return;
+            if (!co_await deadline.rearm(200ms)) {
+                break;
+            }
+            co_await send_http_error(http::status_code::bad_request).await(fd, client_addr, deadline);
+            break;
         }
 
     }
+
+    deadline.clear();
+    // a cancel still on its way could hit the fd after it is closed and reused
+    co_await deadline.settle();
+    release_held(0);
+    // The receiver points into this frame, wait for its final cqe
+    if (!recv_done && receiver.armed) {
+        receiver.stop();
+        co_await coro_io::awaiter::cancel_fd{fd, env::fixed_files ? IORING_ASYNC_CANCEL_FD_FIXED : 0u};
+        while (true) {
+            auto [res, flags, last] = co_await receiver.next();
+            if (res > 0) {
+                io_ctx.recycle_buf(coro_io::awaiter::multishot_recv::buf_id(flags));
+            }
+            if (last) {
+                break;
+            }
+        }
+    }
+    if (env::fixed_files) {
+        co_await coro_io::awaiter::close_direct{fd};
+    }
 }
 
 
 
 coro::simple_task server_loop(int32_t _fd) {
     int32_t fd = _fd;
-    co_await coro::thread::dispatch_awaiter{};
+    co_await schedule_awaiter{};
+    // One armed SQE keeps yielding connections until the listener goes away
+    coro_io::awaiter::multishot_accept acceptor{fd, 0, env::fixed_files};
     while(true){
-        sockaddr_in client_addr;
-        socklen_t client_addr_len = sizeof(client_addr);
-
-        int32_t ret = co_await 
-            coro_io::awaiter::accept{fd, (sockaddr *)&client_addr, &client_addr_len};
+        auto [ret, flags, last] = co_await acceptor.next();
         switch (ret) {
             case coro_io::error::SYS:
             case coro_io::error::CTX_CLOSED:
                 log::async::error("Failed to accept connection: {}", coro_io::error::msg);
                 co_return;
-            case coro_io::error::TIMEOUT:
-                log::async::debug("Accept timed out, retrying...");
-                continue;
             default:
                 break;
         
         }
+        sockaddr_in client_addr{};
+        socklen_t client_addr_len = sizeof(client_addr);
+        // a registered slot has no fd to ask, its peer is logged as 0.0.0.0
+        if (!env::fixed_files) {
+            getpeername(ret, (sockaddr *)&client_addr, &client_addr_len);
+        }
+
         auto ipv4_addr = net::ipv4::from_sockaddr_in(client_addr);
         log::async::info("Fd[{}]: Accepted connection from {}", fd, ipv4_addr.toString());
         async_handle_connection(ret, ipv4_addr);
@@ -427,11 +577,181 @@ struct app& app::POST(std::string_view path, POST_route_handler_t handler) {
 }
 
 
+struct app& app::set_shards(size_t count) {
+    web::env::sharded = true;
+    web::env::shard_count = count;
+    return *this;
+}
+
+struct app& app::set_workers(size_t count) {
+    web::env::worker_count = count;
+    return *this;
+}
+
+struct app& app::set_ring_entries(uint32_t entries) {
+    web::env::ring_entries = entries;
+    return *this;
+}
+
+struct app& app::set_run_to_completion(bool enable) {
+    web::env::run_to_completion = enable;
+    return *this;
+}
+
+struct app& app::set_selective_resume(bool enable) {
+    web::env::selective_resume = enable;
+    return *this;
+}
+
+struct app& app::set_inline_budget(uint32_t budget) {
+    web::env::inline_budget = budget;
+    return *this;
+}
+
+struct app& app::set_busy_poll(std::chrono::microseconds window) {
+    web::env::busy_poll = window;
+    return *this;
+}
+
+struct app& app::set_numa_node(int32_t node) {
+    web::env::numa_node = node;
+    return *this;
+}
+
+struct app& app::set_cpu_pinning(bool enable) {
+    web::env::cpu_pinning = enable;
+    return *this;
+}
+
+struct app& app::set_direct_submit(bool enable) {
+    web::env::direct_submit = enable;
+    return *this;
+}
+
+struct app& app::set_fixed_files(bool enable) {
+    web::env::fixed_files = enable;
+    return *this;
+}
+
+struct app& app::set_max_connections(uint32_t count) {
+    web::env::max_connections = count;
+    return *this;
+}
+
+struct app& app::set_zero_copy_threshold(uint32_t size) {
+    web::env::zero_copy_threshold = size;
+    return *this;
+}
+
+// CPUs every thread is placed on, in order
+static std::vector<size_t> usable_cpus() {
+    if (web::env::numa_node >= 0) {
+        auto cpus = coro::thread::node_cpus(web::env::numa_node);
+        if (!cpus.empty()) {
+            return cpus;
+        }
+        log::sync::warn("NUMA node {} has no usable cpus, using all of them", web::env::numa_node);
+    }
+    return coro::thread::available_cpus();
+}
+
+static void run_sharded(const std::vector<size_t>& cpus){
+    constexpr size_t max_accepter_connections = 256;
+    auto count = web::env::shard_count != 0 ? web::env::shard_count : cpus.size();
+    web::env::accepter_fd_list.reserve(count);
+    web::env::shards.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        auto fd_w = setup_socket(web::env::addr, max_accepter_connections, [](int fd) {
+            int opt = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+        });
+        if (!fd_w.is_valid()) {
+            std::println("Failed to setup socket: {}", strerror(errno));
+            std::terminate();
+        }
+        web::env::accepter_fd_list.push_back(std::move(fd_w));
+        web::env::shards.push_back(std::make_unique<coro_io::ctx>(coro_io::ctx_options{
+            .entries = web::env::ring_entries,
+            .resume = coro_io::resume_mode::run_to_completion,
+            .inline_budget = web::env::inline_budget,
+            .direct_submit = web::env::direct_submit,
+            .busy_poll = web::env::busy_poll,
+        }));
+        if (web::env::cpu_pinning) {
+            web::env::shards.back()->pin_worker(cpus[i % cpus.size()]);
+        }
+    }
+
+    std::signal(SIGINT, [](int) {
+        std::println("Received SIGINT, stopping server...");
+        for (auto& shard : web::env::shards) {
+            shard->request_stop();
+        }
+        // Completes the pending accept of every shard, which wakes its reaper
+        for (auto& fd : web::env::accepter_fd_list) {
+            shutdown(fd.get(), SHUT_RDWR);
+        }
+    });
+
+    std::vector<std::jthread> threads;
+    threads.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        threads.emplace_back([i, cpu = cpus[i % cpus.size()]] {
+            if (web::env::cpu_pinning && !coro::thread::set_affinity(pthread_self(), cpu)) {
+                log::sync::warn("Failed to pin shard {} to cpu {}", i, cpu);
+            }
+            auto& shard = *web::env::shards[i];
+            shard.bind_local();
+            web::env::setup_ring(shard);
+            web::server_loop(web::env::accepter_fd_list[i].get());
+            shard.run();
+        });
+    }
+    threads.clear();
+    web::env::shards.clear();
+}
+
 void app::run(){
     if (!web::env::addr.is_valid()){
         std::println("Server address is not valid");
         std::terminate();
     }
+    auto cpus = usable_cpus();
+    // Without pinning, every thread may still only run on the node. Threads
+    // inherit the mask of this one, so it has to be set before any is started.
+    if (web::env::numa_node >= 0 && !web::env::cpu_pinning
+        && !coro::thread::set_affinity(pthread_self(), cpus)) {
+        log::sync::warn("Failed to bind threads to NUMA node {}", web::env::numa_node);
+    }
+    if (web::env::sharded) {
+        run_sharded(cpus);
+        return;
+    }
+
+    // The ring's reaper (this thread) and submitter get the first two cpus,
+    // the pool workers the rest.
+    size_t reserved = std::min<size_t>(2, cpus.size() - 1);
+    coro::thread::pool_options pool_opts{
+        .workers = web::env::worker_count != 0 ? web::env::worker_count : cpus.size() - reserved,
+    };
+    if (web::env::cpu_pinning) {
+        pool_opts.cpus.assign(cpus.begin() + reserved, cpus.end());
+        if (!coro::thread::set_affinity(pthread_self(), cpus[0])) {
+            log::sync::warn("Failed to pin the ring thread to cpu {}", cpus[0]);
+        }
+    }
+    coro::thread::pool::configure(pool_opts);
+    coro_io::ctx::configure(coro_io::ctx_options{
+        .entries = web::env::ring_entries,
+        .resume = web::env::run_to_completion ? coro_io::resume_mode::run_to_completion
+                : web::env::selective_resume ? coro_io::resume_mode::selective
+                : coro_io::resume_mode::dispatch,
+        .inline_budget = web::env::inline_budget,
+        .busy_poll = web::env::busy_poll,
+    });
+    if (web::env::cpu_pinning) {
+        coro_io::ctx::get_instance().pin_worker(cpus[reserved > 1 ? 1 : 0]);
+    }
     constexpr size_t accepter_count = 4;
     constexpr size_t max_accepter_connections = 256;
     web::env::accepter_fd_list.reserve(accepter_count);
@@ -447,6 +767,7 @@ void app::run(){
         web::env::accepter_fd_list.push_back(std::move(fd_w));
     }
 
+    web::env::setup_ring(coro_io::ctx::get_instance());
     for (uint32_t i = 0; i < web::env::accepter_fd_list.size(); ++i) {
         web::server_loop(web::env::accepter_fd_list[i].get());
     }    
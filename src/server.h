@@ -1,4 +1,5 @@
 #pragma once
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <string_view>
@@ -7,6 +8,10 @@
 #include "io.h"
 #include "meta.h"
 
+namespace coro_io::awaiter {
+struct deadline;
+}
+
 namespace web {
 struct http_file_ctx{
     iovec_wrapper header;
@@ -60,9 +65,9 @@ public:
         struct final_awaiter {
             bool await_ready() noexcept { return false; }
             void await_resume() noexcept {}
-            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h){
-                return h.promise().previous;
-            }
+            // Continues the caller, on the pool if the last write was resumed
+            // inline: the caller goes on with the whole next request.
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept;
         };
         auto final_suspend() noexcept {
             return final_awaiter{};
@@ -75,7 +80,8 @@ public:
         int32_t fd;
         int64_t ret;
         seele::net::ipv4 client_addr;
-        std::chrono::milliseconds timeout;
+        // covers the whole response, nullptr for none
+        const coro_io::awaiter::deadline* deadline = nullptr;
         std::coroutine_handle<> previous;
     };
 
@@ -112,10 +118,10 @@ public:
         std::coroutine_handle<promise_type> coro;
     };
 
-    awaiter await(int fd, seele::net::ipv4 client_addr, std::chrono::milliseconds timeout){
+    awaiter await(int fd, seele::net::ipv4 client_addr, const coro_io::awaiter::deadline& deadline){
         this->handle.promise().fd = fd;
         this->handle.promise().client_addr = client_addr;
-        this->handle.promise().timeout = timeout;
+        this->handle.promise().deadline = &deadline;
         return awaiter{this->handle};
     }
 private:
@@ -125,8 +131,8 @@ private:
 
 struct task{
     send_task t;
-    auto await(int fd, seele::net::ipv4 client_addr, std::chrono::milliseconds timeout){
-        return t.await(fd, client_addr, timeout);
+    auto await(int fd, seele::net::ipv4 client_addr, const coro_io::awaiter::deadline& deadline){
+        return t.await(fd, client_addr, deadline);
     }
     task(send_task&& t): t(std::move(t)){}
 };
@@ -137,8 +143,9 @@ task send_msg(const http::res_msg& msg);
 
 } // namespace web
 
-using GET_route_handler_t = seele::meta::function_ref<web::task(const http::query_t&, const http::header_t&)>;
-using POST_route_handler_t = seele::meta::function_ref<web::task(const http::query_t&, const http::header_t&, const http::body_t&)>;
+// The arguments view the request and are valid until the returned task has sent the response
+using GET_route_handler_t = seele::meta::function_ref<web::task(const http::query_t&, const http::req_header_t&)>;
+using POST_route_handler_t = seele::meta::function_ref<web::task(const http::query_t&, const http::req_header_t&, const http::req_body_t&)>;
 
 struct app{
     app& set_root_path(std::string_view path);
@@ -148,6 +155,52 @@ struct app{
     app& GET(std::string_view path, GET_route_handler_t handler);
 
     app& POST(std::string_view path, POST_route_handler_t handler);
+
+    // Runs `count` shards, each with its own ring, listener and connections.
+    // 0 means one shard per usable CPU.
+    app& set_shards(size_t count);
+
+    // Coroutine pool workers when not sharded, 0 means one per usable CPU
+    // left over by the ring threads.
+    app& set_workers(size_t count);
+
+    // Continues every coroutine on the ring thread, leaving the pool idle.
+    // Shards always do.
+    app& set_run_to_completion(bool enable);
+
+    // Continues only the coroutines that asked for it on the ring thread,
+    // the rest on the pool. By default every coroutine goes to the pool.
+    app& set_selective_resume(bool enable);
+
+    // Coroutines a ring thread resumes inline per batch of completions,
+    // the rest waits (or goes to the pool) so one busy connection can't
+    // keep the ring from being reaped.
+    app& set_inline_budget(uint32_t budget);
+
+    // Ring threads spin this long for completions before going to sleep
+    app& set_busy_poll(std::chrono::microseconds window);
+
+    // Submission queue size of every ring
+    app& set_ring_entries(uint32_t entries);
+
+    // Pins shards, or the ring and pool threads, one per usable CPU
+    app& set_cpu_pinning(bool enable);
+
+    // Only uses the CPUs of NUMA node `node`, -1 for all of them
+    app& set_numa_node(int32_t node);
+
+    // Shards write SQEs straight into their own ring instead of going
+    // through a submitter thread. Only affects sharded mode.
+    app& set_direct_submit(bool enable);
+
+    // Accepts connections straight into a registered file table of
+    // max_connections slots (per ring) and runs all their I/O on fixed files.
+    app& set_fixed_files(bool enable);
+
+    app& set_max_connections(uint32_t count);
+
+    // Files of at least `size` bytes are sent with zero-copy sends, 0 disables.
+    app& set_zero_copy_threshold(uint32_t size);
     
     void run();
 };